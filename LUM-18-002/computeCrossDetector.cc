@@ -0,0 +1,123 @@
+// Native version of compute_crossdetector.py. Instead of running brilcalc once per normtag and per period,
+// this reads the per-LS brilcalc output for each normtag once and then applies any number of json masks to
+// it, printing the integrated luminosity for each normtag and its difference from the average, just like
+// the python script. So you can do e.g. per-fill or per-week comparisons over a whole year in one go.
+//
+// First make the per-LS csv files, covering (at least) all the periods in the masks:
+// brilcalc lumi --byls -u /nb -f 6868 --normtag hfoc18PAS -o hfoc18PAS.csv
+// and similarly for the other normtags. Note that the units must be /nb (not hz/ub) so that the delivered
+// column is the integrated luminosity per LS. Then compile and run with:
+// g++ -O3 -std=c++17 -pthread -o computeCrossDetector computeCrossDetector.cc
+// ./computeCrossDetector [-d csvdir] [-i mask.json ...] [-n normtag=factor ...] [normtag ...]
+// Each normtag is read from <csvdir>/<normtag>.csv; you can also give normtag=file.csv to use a different
+// file. With no masks it uses vdm2018.json, and with no normtags it uses the same ones as the python script.
+// Like the python script (and brilcalc -n), the luminosity of the old normtags in scaleFactors is scaled to
+// the final cross sections; -n adds or overrides a scale factor for a normtag.
+// The fixture directory has a small synthetic set of inputs, so you can try it without BRIL access:
+// ./computeCrossDetector -d fixture -i vdm2018.json -i fixture/run318982.json
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include "../common/BrilcalcCSV.h"
+#include "../common/LumiMerge.h"
+#include "../common/LumiMask.h"
+
+// Normtags to use by default
+const char *defaultNormtags[] = {"hfoc18PAS", "hfet18PAS", "pcc18PAS", "bcm1f18PAS", "pltReproc18PAS"};
+// JSON file defining the flat-top periods during the VdM scan that we use for the comparison
+const char *defaultJsonFile = "vdm2018.json";
+// Scale factors: these were needed with the old normtags to scale the result of the old normtags to the final
+// cross sections. The final normtags already have the final cross sections in them, so they don't need any.
+const std::map<std::string, double> defaultScaleFactors = {
+  {"hfoc18v6", 805.9/803.99}, {"hfet18v6", 2503.6/2508.09}, {"pcc18v4", 5.982/5.99746},
+  {"pltzero18v4Reproc", 261.8/259.98}, {"bcm1fpcvd18test14", 197.84/198.53}
+};
+
+int main(int argc, char **argv) {
+  std::string csvDir = ".";
+  std::vector<std::string> jsonFiles;
+  std::vector<std::string> normtags;
+  std::vector<std::string> fileNames;
+  std::map<std::string, double> scaleFactors = defaultScaleFactors;
+  bool usageError = false;
+
+  for (int i=1; i<argc; ++i) {
+    if (!strcmp(argv[i], "-d") && i+1 < argc) {
+      csvDir = argv[++i];
+    } else if (!strcmp(argv[i], "-i") && i+1 < argc) {
+      jsonFiles.push_back(argv[++i]);
+    } else if (!strcmp(argv[i], "-n") && i+1 < argc) {
+      std::string arg = argv[++i];
+      size_t eq = arg.find('=');
+      char *end = nullptr;
+      double factor = (eq == std::string::npos) ? 0 : strtod(arg.c_str() + eq + 1, &end);
+      if (eq == std::string::npos || eq == 0 || *end != '\0' || factor <= 0) {
+	usageError = true;
+	break;
+      }
+      scaleFactors[arg.substr(0, eq)] = factor;
+    } else if (argv[i][0] == '-') {
+      usageError = true;
+      break;
+    } else {
+      std::string arg = argv[i];
+      size_t eq = arg.find('=');
+      normtags.push_back(arg.substr(0, eq));
+      fileNames.push_back(eq == std::string::npos ? "" : arg.substr(eq+1));
+    }
+  }
+  if (usageError) {
+    std::cerr << "Usage: " << argv[0] << " [-d csvdir] [-i mask.json ...] [-n normtag=factor ...] [normtag[=file.csv] ...]" << std::endl;
+    return 1;
+  }
+  if (jsonFiles.empty()) jsonFiles.push_back(defaultJsonFile);
+  if (normtags.empty()) {
+    normtags.assign(std::begin(defaultNormtags), std::end(defaultNormtags));
+    fileNames.assign(normtags.size(), "");
+  }
+  for (size_t n=0; n<normtags.size(); ++n)
+    if (fileNames[n].empty()) fileNames[n] = csvDir + "/" + normtags[n] + ".csv";
+
+  std::vector<brilcsv::LumiMask> masks(jsonFiles.size());
+  for (size_t m=0; m<jsonFiles.size(); ++m)
+    if (!masks[m].read(jsonFiles[m].c_str())) return 1;
+
+  // Read each normtag once (in parallel, and through the binary cache), then apply all the masks to it.
+  std::vector<brilcsv::BrilcalcLumiData> csvData;
+  if (!brilcsv::readBrilcalcByLSParallel(fileNames, csvData, true)) return 1;
+
+  // lumi[m][n] is the integrated lumi for mask m and normtag n
+  std::vector<std::vector<double> > lumi(masks.size(), std::vector<double>(normtags.size()));
+  brilcsv::parallelFor(normtags.size(), [&](int n) {
+    auto sf = scaleFactors.find(normtags[n]);
+    const double scale = (sf == scaleFactors.end()) ? 1.0 : sf->second;
+    std::vector<unsigned char> selected;
+    for (size_t m=0; m<masks.size(); ++m) {
+      masks[m].select(csvData[n].run, csvData[n].cmsls, selected);
+      lumi[m][n] = scale*brilcsv::maskedSum(csvData[n].delivered, selected);
+    }
+  });
+
+  // Output, sorted by normtag name like the python script
+  std::vector<size_t> order(normtags.size());
+  for (size_t n=0; n<order.size(); ++n) order[n] = n;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return normtags[a] < normtags[b]; });
+
+  for (size_t m=0; m<masks.size(); ++m) {
+    double avgTotal = 0;
+    for (size_t n=0; n<normtags.size(); ++n)
+      avgTotal += lumi[m][n];
+    avgTotal /= normtags.size();
+
+    if (masks.size() > 1) printf("%s\n", jsonFiles[m].c_str());
+    for (size_t n : order)
+      printf("%s %.3f %+.1f%%\n", normtags[n].c_str(), lumi[m][n], avgTotal > 0 ? 100*(lumi[m][n]-avgTotal)/avgTotal : 0.0);
+  }
+  return 0;
+}
@@ -0,0 +1,217 @@
+// Header-only reader for the csv files we feed into the plotting macros: the per-LS output of brilcalc
+// (brilcalc lumi --byls ...) and simple numeric csv files like HFOCAging.csv. The file is mmapped and
+// tokenized in place with std::string_view and std::from_chars, so there are no per-line or per-field heap
+// allocations; the results come back as plain columnar arrays that can be handed straight to a TGraph.
+// This needs C++17 (and a compiler whose std::from_chars supports floating point, e.g. gcc 11 or newer),
+// which is what ROOT 6.22 and later are built with by default.
+
+#ifndef PAPERPLOTS_BRILCALCCSV_H
+#define PAPERPLOTS_BRILCALCCSV_H
+
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace brilcsv {
+
+// Read-only memory map of a whole file. An empty file is valid and just has empty contents.
+class MappedFile {
+public:
+  explicit MappedFile(const char *fileName) {
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (::fstat(fd, &st) == 0) {
+      size_ = st.st_size;
+      if (size_ == 0) {
+	isOpen_ = true;
+      } else {
+	void *addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr != MAP_FAILED) {
+	  data_ = static_cast<const char*>(addr);
+	  ::madvise(addr, size_, MADV_SEQUENTIAL);
+	  isOpen_ = true;
+	}
+      }
+    }
+    ::close(fd);
+  }
+  ~MappedFile() { if (data_) ::munmap(const_cast<char*>(data_), size_); }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool isOpen() const { return isOpen_; }
+  size_t size() const { return size_; }
+  std::string_view contents() const { return std::string_view(data_, data_ ? size_ : 0); }
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+  bool isOpen_ = false;
+};
+
+// Calls f(line) for every line of text (without the line terminator; a trailing \r is also stripped).
+template<typename F>
+inline void forEachLine(std::string_view text, F&& f) {
+  const char *p = text.data();
+  const char *end = p + text.size();
+  while (p < end) {
+    const char *nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    const char *lineEnd = nl ? nl : end;
+    std::string_view line(p, lineEnd - p);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+    f(line);
+    p = lineEnd + 1;
+  }
+}
+
+// Splits line on commas into fields[0..maxFields). Returns the number of fields in the line, which may be
+// larger than maxFields (in which case only the first maxFields are filled in).
+inline int splitFields(std::string_view line, std::string_view *fields, int maxFields) {
+  int n = 0;
+  size_t start = 0;
+  while (true) {
+    size_t comma = line.find(',', start);
+    std::string_view field = line.substr(start, comma == std::string_view::npos ? std::string_view::npos : comma - start);
+    if (n < maxFields) fields[n] = field;
+    ++n;
+    if (comma == std::string_view::npos) break;
+    start = comma + 1;
+  }
+  return n;
+}
+
+// Number parsing. These return false unless the whole field is consumed.
+inline bool parseFloat(std::string_view s, float &value) {
+  auto res = std::from_chars(s.data(), s.data() + s.size(), value);
+  return res.ec == std::errc() && res.ptr == s.data() + s.size();
+}
+
+inline bool parseInt(std::string_view s, int &value) {
+  auto res = std::from_chars(s.data(), s.data() + s.size(), value);
+  return res.ec == std::errc() && res.ptr == s.data() + s.size();
+}
+
+// Parses "a:b", as used in the run:fill and ls:cmsls fields of the brilcalc output.
+inline bool parseIntPair(std::string_view s, int &a, int &b) {
+  size_t colon = s.find(':');
+  if (colon == std::string_view::npos) return false;
+  return parseInt(s.substr(0, colon), a) && parseInt(s.substr(colon + 1), b);
+}
+
+// Per-LS luminosity from brilcalc lumi --byls, stored by column. The csv columns are
+// run:fill,ls:cmsls,time,beamstatus,E(GeV),delivered,recorded,avgpu,source; ls is the lumi LS number
+// and cmsls the CMS LS number (0 if CMS wasn't taking data).
+struct BrilcalcLumiData {
+  std::vector<int> run;
+  std::vector<int> fill;
+  std::vector<int> ls;
+  std::vector<int> cmsls;
+  std::vector<float> delivered;
+  std::vector<float> recorded;
+
+  size_t size() const { return run.size(); }
+  void reserve(size_t n) {
+    run.reserve(n); fill.reserve(n); ls.reserve(n); cmsls.reserve(n);
+    delivered.reserve(n); recorded.reserve(n);
+  }
+  void clear() {
+    run.clear(); fill.clear(); ls.clear(); cmsls.clear();
+    delivered.clear(); recorded.clear();
+  }
+};
+
+static const int nBrilcalcFields = 9;
+
+// Parses the contents of a brilcalc --byls csv file into data (which is cleared first). Blank lines and
+// comment lines are skipped and malformed lines are reported and skipped, so data has one entry per good
+// LS, in file order.
+inline void parseBrilcalcByLS(std::string_view contents, BrilcalcLumiData &data) {
+  data.clear();
+  // Lines are ~100 characters long, so this is a slight overestimate, which saves reallocating.
+  data.reserve(contents.size()/64 + 1);
+
+  forEachLine(contents, [&](std::string_view line) {
+    if (line.empty()) return; // skip blank lines
+    if (line[0] == '#') return; // skip comment lines
+
+    std::string_view fields[nBrilcalcFields];
+    int run, fill, ls, cmsls;
+    float delivered, recorded;
+    if (splitFields(line, fields, nBrilcalcFields) != nBrilcalcFields ||
+	!parseIntPair(fields[0], run, fill) || !parseIntPair(fields[1], ls, cmsls) ||
+	!parseFloat(fields[5], delivered) || !parseFloat(fields[6], recorded)) {
+      std::cout << "Malformed line in csv file: " << line << std::endl;
+      return;
+    }
+    data.run.push_back(run);
+    data.fill.push_back(fill);
+    data.ls.push_back(ls);
+    data.cmsls.push_back(cmsls);
+    data.delivered.push_back(delivered);
+    data.recorded.push_back(recorded);
+  });
+}
+
+// Reads a brilcalc --byls csv file into data, as above. Returns false if the file can't be opened.
+inline bool readBrilcalcByLS(const char *fileName, BrilcalcLumiData &data) {
+  data.clear();
+  MappedFile file(fileName);
+  if (!file.isOpen()) {
+    std::cerr << "ERROR: cannot open csv file: " << fileName << std::endl;
+    return false;
+  }
+  parseBrilcalcByLS(file.contents(), data);
+  return true;
+}
+
+// Calls f(row) for every data line of text from a numeric csv file with nFields fields per line, where
+// row[i] is the value of field columns[i]. Lines that don't start with a digit (headers, comments) are
+// skipped, and lines with the wrong number of fields or non-numeric values are reported and skipped.
+template<typename F>
+inline void forEachCSVRow(std::string_view text, int nFields, const std::vector<int> &columns, F&& f) {
+  std::vector<std::string_view> fields(nFields);
+  std::vector<float> row(columns.size());
+  forEachLine(text, [&](std::string_view line) {
+    if (line.empty()) return; // skip blank lines
+    if (line[0] < '0' || line[0] > '9') return; // skip header (or other non-numeric) lines
+
+    bool good = (splitFields(line, fields.data(), nFields) == nFields);
+    for (size_t i=0; good && i<columns.size(); ++i)
+      good = parseFloat(fields[columns[i]], row[i]);
+    if (!good) {
+      std::cout << "Malformed line in csv file: " << line << std::endl;
+      return;
+    }
+    f(static_cast<const float*>(row.data()));
+  });
+}
+
+// Reads the given columns from a numeric csv file with nFields fields per line (see forEachCSVRow);
+// columns[i] ends up in values[i]. Returns false if the file can't be opened.
+inline bool readCSVColumns(const char *fileName, int nFields, const std::vector<int> &columns,
+			   std::vector<std::vector<float> > &values) {
+  values.assign(columns.size(), std::vector<float>());
+  MappedFile file(fileName);
+  if (!file.isOpen()) {
+    std::cerr << "ERROR: cannot open csv file: " << fileName << std::endl;
+    return false;
+  }
+
+  forEachCSVRow(file.contents(), nFields, columns, [&](const float *row) {
+    for (size_t i=0; i<columns.size(); ++i)
+      values[i].push_back(row[i]);
+  });
+  return true;
+}
+
+} // namespace brilcsv
+
+#endif
@@ -0,0 +1,119 @@
+// ROOT side of LumiGaps.h: makes the graphs for a luminometer whose data has been laid out on a broken LS
+// axis (one TGraph per segment, so there are no lines drawn across gaps), and draws the broken x axis itself
+// (labelled with the true LS numbers, with a break mark at each cut). This replaces relabelling the bins of
+// the graph's own axis, which never quite worked with ticks.
+
+#ifndef PAPERPLOTS_BROKENAXISPLOT_H
+#define PAPERPLOTS_BROKENAXISPLOT_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "TGraph.h"
+#include "TGaxis.h"
+#include "TH1.h"
+#include "TLine.h"
+#include "TVirtualPad.h"
+#include "LumiGaps.h"
+#include "GraphDecimation.h"
+
+namespace brilcsv {
+
+// Width in pixels of the plotting area of a pad.
+inline int plotPixelWidth(TVirtualPad *pad) {
+  return pad->GetWw()*pad->GetAbsWNDC()*(1 - pad->GetLeftMargin() - pad->GetRightMargin());
+}
+
+// Makes a graph of the points of x vs. y in [xmin, xmax], decimated to nPixels (or with all the points if
+// nPixels is 0).
+inline TGraph *makeGraph(const std::vector<float> &x, const std::vector<float> &y, double xmin, double xmax, int nPixels) {
+  std::vector<float> decX, decY;
+  decimateMinMax(x.data(), y.data(), x.size(), xmin, xmax, nPixels, decX, decY);
+  return new TGraph(decX.size(), decX.data(), decY.data());
+}
+
+// Decimates each segment of the series to nPixels across [xmin, xmax] (or just keeps the points in [xmin,
+// xmax] if nPixels is 0), keeping the same segments.
+inline SegmentedSeries decimateSegments(const SegmentedSeries &series, double xmin, double xmax, int nPixels) {
+  SegmentedSeries decimated;
+  decimated.segmentStart.push_back(0);
+  std::vector<float> decX, decY;
+  for (size_t k=0; k<series.nSegments(); ++k) {
+    decimateMinMax(series.segmentX(k), series.segmentY(k), series.segmentSize(k), xmin, xmax, nPixels, decX, decY);
+    decimated.x.insert(decimated.x.end(), decX.begin(), decX.end());
+    decimated.y.insert(decimated.y.end(), decY.begin(), decY.end());
+    decimated.segmentStart.push_back(decimated.x.size());
+  }
+  return decimated;
+}
+
+// Makes one graph per segment of the series, with all its points.
+inline std::vector<TGraph*> makeSegmentGraphs(const SegmentedSeries &series) {
+  std::vector<TGraph*> graphs;
+  for (size_t k=0; k<series.nSegments(); ++k)
+    graphs.push_back(new TGraph(series.segmentSize(k), series.segmentX(k), series.segmentY(k)));
+  return graphs;
+}
+
+// Makes one graph per segment of the series, decimated to nPixels across [xmin, xmax] (or with all the
+// points if nPixels is 0).
+inline std::vector<TGraph*> makeSegmentGraphs(const SegmentedSeries &series, double xmin, double xmax, int nPixels) {
+  return makeSegmentGraphs(decimateSegments(series, xmin, xmax, nPixels));
+}
+
+// Draws an empty frame in the current pad spanning [xmin, xmax] in x and [ymin, ymax] plus a 10% margin in
+// y (like a TGraph drawn with "A" would have), for the segment graphs to be drawn on top of. If the broken
+// axis is going to be drawn with drawBrokenXAxis, the frame's own x axis labels and ticks are turned off.
+inline TH1 *drawFrame(double xmin, double xmax, double ymin, double ymax, bool brokenAxis) {
+  double dy = 0.1*(ymax - ymin);
+  double frameYmin = (ymin >= 0 && ymin - dy < 0) ? 0 : ymin - dy;
+  TH1 *frame = gPad->DrawFrame(xmin, frameYmin, xmax, ymax + dy);
+  if (brokenAxis) {
+    frame->GetXaxis()->SetLabelSize(0);
+    frame->GetXaxis()->SetTickLength(0);
+  }
+  return frame;
+}
+
+// Draws the x axis for the LS range [lsMin, lsMax] along the bottom of the current pad, with the cuts in
+// axis removed: each visible part gets its own axis labelled with the true LS numbers, and each cut gets
+// a break mark. Anything outside the pad's x range is left out. Call this after drawing everything else so
+// the ticks end up on top.
+inline void drawBrokenXAxis(const BrokenLSAxis &axis, int lsMin, int lsMax, double labelSize) {
+  gPad->Update();
+  const double y = gPad->GetUymin();
+  const double uxmin = gPad->GetUxmin(), uxmax = gPad->GetUxmax();
+  const double xRange = uxmax - uxmin;
+  const double yRange = gPad->GetUymax() - gPad->GetUymin();
+
+  for (const LSRange &r : axis.visibleRanges(lsMin, lsMax)) {
+    // The LS numbers run 1:1 with the display position within a part.
+    const double start = axis.toDisplay(r.first);
+    const double x1 = std::max(start, uxmin), x2 = std::min<double>(axis.toDisplay(r.last), uxmax);
+    if (x2 <= x1) continue;
+    // Scale the number of divisions with the length of this part of the axis.
+    int nDiv = std::min(10, std::max(2, static_cast<int>(std::lround(10*(x2 - x1)/xRange))));
+    TGaxis *part = new TGaxis(x1, y, x2, y, r.first + (x1 - start), r.first + (x2 - start), 500 + nDiv);
+    part->SetLabelSize(labelSize);
+    part->SetLabelFont(42);
+    part->Draw();
+  }
+
+  // The little "cutout" marks: blank out the axis line at the break and draw two slashes.
+  for (size_t i=0; i<axis.cuts().size(); ++i) {
+    double x = axis.breakPosition(i);
+    if (x < uxmin || x > uxmax) continue;
+    double dx = 0.004*xRange, dy = 0.04*yRange;
+    TLine *blank = new TLine(x - dx, y, x + dx, y);
+    blank->SetLineColor(kWhite);
+    blank->Draw();
+    TLine *slash1 = new TLine(x - 2*dx, y - dy, x, y + dy);
+    slash1->Draw();
+    TLine *slash2 = new TLine(x, y - dy, x + 2*dx, y + dy);
+    slash2->Draw();
+  }
+}
+
+} // namespace brilcsv
+
+#endif
@@ -0,0 +1,172 @@
+// Kernels for the per-bunch luminosity matrix from BunchLumi.h: per-LS sums over a selection of bunches,
+// finding the colliding, leading and train bunches, and per-BX ratios between luminometers. A bunch
+// selection is a row of weights (1 for selected BX, 0 otherwise, with the same padding as the matrix), so
+// summing over the selected bunches is just a dot product of each row with the weights, with no branches.
+//
+// The inner loops use GCC/clang vector extensions (8 floats at a time, with two accumulators) rather than
+// intrinsics, so the same code compiles to AVX when that's enabled (e.g. -march=native), to pairs of SSE
+// instructions otherwise, and to NEON on ARM, and also works in ACLiC and cling. The compiler won't vectorize
+// float sums like this by itself without -ffast-math, since it changes the order of the additions.
+
+#ifndef PAPERPLOTS_BUNCHKERNELS_H
+#define PAPERPLOTS_BUNCHKERNELS_H
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "BunchLumi.h"
+#include "LumiMerge.h"
+
+namespace brilcsv {
+
+// 8 floats. This is declared like the intrinsics types (may_alias) so that rows can be read through it, and
+// with 4-byte alignment so it can be used on any float pointer. The vectors are only ever used locally,
+// never passed to or returned from functions, so the ABI doesn't depend on whether AVX is enabled.
+typedef float floatv __attribute__((vector_size(32), __may_alias__, aligned(4)));
+static const int floatvWidth = 8;
+static_assert(bxStride % (2*floatvWidth) == 0, "the kernels assume the row length is a multiple of 16");
+
+inline const floatv &asVector(const float *p) { return *reinterpret_cast<const floatv*>(p); }
+inline floatv &asVector(float *p) { return *reinterpret_cast<floatv*>(p); }
+
+inline float horizontalSum(const floatv &v) {
+  float sum = 0;
+  for (int k=0; k<floatvWidth; ++k) sum += v[k];
+  return sum;
+}
+
+// Sum of row[b]*weights[b] over one row; if weights is null, the plain sum.
+inline float sumRow(const float *row, const float *weights) {
+  floatv acc0 = {}, acc1 = {};
+  if (weights) {
+    for (int b=0; b<bxStride; b += 2*floatvWidth) {
+      acc0 += asVector(row + b)*asVector(weights + b);
+      acc1 += asVector(row + b + floatvWidth)*asVector(weights + b + floatvWidth);
+    }
+  } else {
+    for (int b=0; b<bxStride; b += 2*floatvWidth) {
+      acc0 += asVector(row + b);
+      acc1 += asVector(row + b + floatvWidth);
+    }
+  }
+  acc0 += acc1;
+  return horizontalSum(acc0);
+}
+
+// acc[b] += row[b] for the whole row.
+inline void addRow(float *acc, const float *row) {
+  for (int b=0; b<bxStride; b += floatvWidth) asVector(acc + b) += asVector(row + b);
+}
+
+// Luminosity per LS summed over the selected bunches (all of them if weights is null), i.e. out[i] is the
+// luminosity of LS i from just those bunches.
+inline void sumPerLS(const BunchLumiData &data, const float *weights, std::vector<float> &out, int nThreads = 0) {
+  const size_t n = data.size();
+  out.resize(n);
+  const int blockSize = 1024;
+  const int nBlocks = (n + blockSize - 1)/blockSize;
+  parallelFor(nBlocks, [&](int k) {
+    const size_t end = std::min(n, static_cast<size_t>(k + 1)*blockSize);
+    for (size_t i = static_cast<size_t>(k)*blockSize; i < end; ++i) out[i] = sumRow(data.row(i), weights);
+  }, nThreads);
+}
+
+// Sum over LS of the luminosity in each BX, for the LS where useRow is set (all of them if useRow is empty).
+// Each thread sums its share of the rows into its own accumulator, and those are added up at the end.
+inline void sumPerBX(const BunchLumiData &data, const std::vector<char> &useRow, AlignedFloats &out, int nThreads = 0) {
+  if (nThreads <= 0) nThreads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t n = data.size();
+  const int nParts = std::max<size_t>(1, std::min<size_t>(nThreads, n/64));
+  std::vector<AlignedFloats> partial(nParts, AlignedFloats(bxStride, 0));
+  parallelFor(nParts, [&](int t) {
+    for (size_t i = n*t/nParts; i < n*(t+1)/nParts; ++i)
+      if (useRow.empty() || useRow[i]) addRow(partial[t].data(), data.row(i));
+  }, nThreads);
+  out.assign(bxStride, 0);
+  for (const AlignedFloats &p : partial) addRow(out.data(), p.data());
+}
+
+// The colliding bunches: the BX whose luminosity summed over the whole data set is above fraction of the
+// largest. Returns the selection weights.
+inline AlignedFloats findCollidingBX(const BunchLumiData &data, float fraction = 0.1, int nThreads = 0) {
+  AlignedFloats total;
+  sumPerBX(data, {}, total, nThreads);
+  const float threshold = fraction*(*std::max_element(total.begin(), total.begin() + nBX));
+  AlignedFloats colliding(bxStride, 0);
+  for (int b=0; b<nBX; ++b) colliding[b] = (total[b] > threshold && total[b] > 0) ? 1 : 0;
+  return colliding;
+}
+
+// Leading bunches: colliding bunches with no colliding bunch in the BX before (the orbit wraps around, so
+// BX 1 follows BX 3564).
+inline AlignedFloats leadingBX(const AlignedFloats &colliding) {
+  AlignedFloats leading(bxStride, 0);
+  for (int b=0; b<nBX; ++b) leading[b] = (colliding[b] > 0 && colliding[(b + nBX - 1) % nBX] == 0) ? 1 : 0;
+  return leading;
+}
+
+// Train bunches: the colliding bunches that aren't leading bunches.
+inline AlignedFloats trainBX(const AlignedFloats &colliding) {
+  AlignedFloats train(bxStride, 0);
+  for (int b=0; b<nBX; ++b) train[b] = (colliding[b] > 0 && colliding[(b + nBX - 1) % nBX] > 0) ? 1 : 0;
+  return train;
+}
+
+// Makes the selection weights from a description of the bunches: "all", "colliding", "leading", "train",
+// or a comma-separated list of BX numbers and ranges like "1,41-50". The colliding bunches are found from
+// reference. Returns false if the description doesn't make sense.
+inline bool selectBX(const std::string &spec, const BunchLumiData &reference, AlignedFloats &weights, int nThreads = 0) {
+  if (spec == "all") {
+    weights.assign(bxStride, 0);
+    std::fill(weights.begin(), weights.begin() + nBX, 1);
+    return true;
+  }
+  if (spec == "colliding" || spec == "leading" || spec == "train") {
+    AlignedFloats colliding = findCollidingBX(reference, 0.1, nThreads);
+    weights = (spec == "colliding") ? colliding : (spec == "leading") ? leadingBX(colliding) : trainBX(colliding);
+    return true;
+  }
+  weights.assign(bxStride, 0);
+  std::string_view rest(spec);
+  while (!rest.empty()) {
+    size_t comma = rest.find(',');
+    std::string_view item = rest.substr(0, comma);
+    rest = (comma == std::string_view::npos) ? std::string_view() : rest.substr(comma + 1);
+    int first, last;
+    size_t dash = item.find('-');
+    if (dash == std::string_view::npos) {
+      if (!parseInt(item, first)) return false;
+      last = first;
+    } else if (!parseInt(item.substr(0, dash), first) || !parseInt(item.substr(dash + 1), last)) {
+      return false;
+    }
+    if (first < 1 || last > nBX || first > last) return false;
+    std::fill(weights.begin() + first - 1, weights.begin() + last, 1);
+  }
+  return true;
+}
+
+// Ratio of luminometer num to luminometer den in each BX, summed over the LS they have in common
+// (denIndex is an LSIndex built from den.perLS). BX where den is 0 get a ratio of 0.
+inline void ratioPerBX(const BunchLumiData &num, const BunchLumiData &den, const LSIndex &denIndex, AlignedFloats &out,
+		       int nThreads = 0) {
+  // Find the matching rows first, and then add up whole rows, so the inner loops are all SIMD.
+  std::vector<char> useNum(num.size(), 0), useDen(den.size(), 0);
+  for (size_t i=0; i<num.size(); ++i) {
+    int j = denIndex.find(num.perLS.run[i], num.perLS.ls[i]);
+    if (j < 0) continue;
+    useNum[i] = 1;
+    useDen[j] = 1;
+  }
+  AlignedFloats numSum, denSum;
+  sumPerBX(num, useNum, numSum, nThreads);
+  sumPerBX(den, useDen, denSum, nThreads);
+  out.assign(bxStride, 0);
+  for (int b=0; b<nBX; ++b) out[b] = (denSum[b] > 0) ? numSum[b]/denSum[b] : 0;
+}
+
+} // namespace brilcsv
+
+#endif
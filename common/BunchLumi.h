@@ -0,0 +1,212 @@
+// Reader for the per-bunch output of brilcalc (brilcalc lumi --byls --xing), which has the same nine fields
+// as the --byls output followed by a tenth with the luminosity in each bunch crossing:
+// run:fill,ls:cmsls,time,beamstatus,E(GeV),delivered,recorded,avgpu,source,[bxidx bxdelivered bxrecorded ...]
+// where the last field lists (BX number, delivered, recorded) for each BX that brilcalc kept (so it's
+// usually just the colliding ones). This is stored as a dense LS x BX matrix of the delivered luminosity, one
+// row per LS, with every row padded to a multiple of 64 bytes and the whole matrix 64-byte aligned, so that
+// the kernels in BunchKernels.h can run straight down the rows with SIMD loads. At ~14 kB per LS per
+// luminometer that's a few GB for a full year, so the file is parsed in parallel directly into the matrix
+// rather than building it up line by line.
+
+#ifndef PAPERPLOTS_BUNCHLUMI_H
+#define PAPERPLOTS_BUNCHLUMI_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "BrilcalcCSV.h"
+#include "LumiCache.h"
+#include "LumiMerge.h"
+
+namespace brilcsv {
+
+static const int nBX = 3564;
+// Row length of the matrix: nBX rounded up to a multiple of 16 floats (64 bytes). The padding is always 0.
+static const int bxStride = 3568;
+static const size_t bxAlignment = 64;
+
+// Allocator for vectors whose data should start on a 64-byte boundary (a cache line, and the widest SIMD
+// register we'd use).
+template<typename T>
+struct AlignedAllocator {
+  typedef T value_type;
+  AlignedAllocator() {}
+  template<typename U> AlignedAllocator(const AlignedAllocator<U>&) {}
+  T *allocate(size_t n) { return static_cast<T*>(::operator new(n*sizeof(T), std::align_val_t(bxAlignment))); }
+  void deallocate(T *p, size_t) { ::operator delete(p, std::align_val_t(bxAlignment)); }
+  template<typename U> bool operator==(const AlignedAllocator<U>&) const { return true; }
+  template<typename U> bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+typedef std::vector<float, AlignedAllocator<float> > AlignedFloats;
+
+struct BunchLumiData {
+  // The per-LS fields (run, fill, LS and the per-LS totals), as from readBrilcalcByLS.
+  BrilcalcLumiData perLS;
+  // Delivered luminosity per BX: row i (for perLS entry i) is bx[i*bxStride, (i+1)*bxStride), with BX number
+  // b (counting from 1, as brilcalc does) at position b-1. BX not listed in the file are 0.
+  AlignedFloats bx;
+
+  size_t size() const { return perLS.size(); }
+  float *row(size_t i) { return bx.data() + i*bxStride; }
+  const float *row(size_t i) const { return bx.data() + i*bxStride; }
+  void clear() {
+    perLS.clear();
+    bx.clear();
+  }
+};
+
+// Parses the bracketed per-BX field into row (which must already be zeroed). Returns false if it's
+// malformed or has a BX number outside [1, nBX].
+inline bool parseXingField(std::string_view field, float *row) {
+  if (field.size() < 2 || field.front() != '[' || field.back() != ']') return false;
+  const char *p = field.data() + 1;
+  const char *end = field.data() + field.size() - 1;
+  while (true) {
+    while (p < end && *p == ' ') ++p;
+    if (p == end) return true;
+    int bxidx;
+    float delivered, recorded;
+    auto res = std::from_chars(p, end, bxidx);
+    if (res.ec != std::errc() || res.ptr == end || *res.ptr != ' ') return false;
+    res = std::from_chars(res.ptr + 1, end, delivered);
+    if (res.ec != std::errc() || res.ptr == end || *res.ptr != ' ') return false;
+    res = std::from_chars(res.ptr + 1, end, recorded);
+    if (res.ec != std::errc() || (res.ptr != end && *res.ptr != ' ')) return false;
+    if (bxidx < 1 || bxidx > nBX) return false;
+    row[bxidx-1] = delivered;
+    p = res.ptr;
+  }
+}
+
+// Parses one --xing line into entry i of data. Returns false if it's malformed.
+inline bool parseXingLine(std::string_view line, BunchLumiData &data, size_t i) {
+  std::string_view fields[10];
+  if (splitFields(line, fields, 10) != 10) return false;
+  BrilcalcLumiData &perLS = data.perLS;
+  return parseIntPair(fields[0], perLS.run[i], perLS.fill[i]) && parseIntPair(fields[1], perLS.ls[i], perLS.cmsls[i]) &&
+    parseFloat(fields[5], perLS.delivered[i]) && parseFloat(fields[6], perLS.recorded[i]) &&
+    parseXingField(fields[9], data.row(i));
+}
+
+// Parses the contents of a --xing csv file into data, using nThreads threads (0 means one per core). The file
+// is cut into chunks (of at least minChunk bytes) at line boundaries; a first pass counts the data lines in
+// each chunk, so that the matrix can be allocated once, and then each chunk is parsed straight into its own
+// rows. Malformed lines are reported and dropped.
+inline void parseBrilcalcXing(std::string_view contents, BunchLumiData &data, int nThreads = 0, size_t minChunk = 1 << 20) {
+  data.clear();
+  if (nThreads <= 0) nThreads = std::max(1u, std::thread::hardware_concurrency());
+  minChunk = std::max<size_t>(minChunk, 1);
+  const int nChunks = std::max<size_t>(1, std::min<size_t>(4*nThreads, contents.size()/minChunk));
+  std::vector<std::string_view> chunks;
+  size_t start = 0;
+  for (int c=1; c<=nChunks && start < contents.size(); ++c) {
+    size_t end = (c == nChunks) ? contents.size() : contents.size()*c/nChunks;
+    if (end < start) end = start;
+    while (end < contents.size() && contents[end-1] != '\n') ++end;
+    chunks.push_back(contents.substr(start, end - start));
+    start = end;
+  }
+
+  // Data lines are the ones starting with a digit; everything else is a header or comment.
+  auto isData = [](std::string_view line) { return !line.empty() && line[0] >= '0' && line[0] <= '9'; };
+  std::vector<size_t> first(chunks.size() + 1, 0);
+  parallelFor(chunks.size(), [&](int c) {
+    size_t n = 0;
+    forEachLine(chunks[c], [&](std::string_view line) { if (isData(line)) ++n; });
+    first[c+1] = n;
+  }, nThreads);
+  for (size_t c=0; c<chunks.size(); ++c) first[c+1] += first[c];
+  const size_t nLines = first.back();
+
+  BrilcalcLumiData &perLS = data.perLS;
+  perLS.run.resize(nLines);
+  perLS.fill.resize(nLines);
+  perLS.ls.resize(nLines);
+  perLS.cmsls.resize(nLines);
+  perLS.delivered.resize(nLines);
+  perLS.recorded.resize(nLines);
+  data.bx.resize(nLines*bxStride);
+
+  std::vector<char> good(nLines, 1);
+  std::vector<std::ostringstream> warnings(chunks.size());
+  parallelFor(chunks.size(), [&](int c) {
+    size_t i = first[c];
+    forEachLine(chunks[c], [&](std::string_view line) {
+      if (!isData(line)) return;
+      if (!parseXingLine(line, data, i)) {
+	warnings[c] << "Malformed line in csv file: " << line.substr(0, 100) << (line.size() > 100 ? "..." : "") << std::endl;
+	good[i] = 0;
+      }
+      ++i;
+    });
+  }, nThreads);
+  for (auto &w : warnings) std::cout << w.str();
+
+  // Squeeze out the malformed lines, if there were any.
+  if (std::find(good.begin(), good.end(), 0) == good.end()) return;
+  size_t n = 0;
+  for (size_t i=0; i<nLines; ++i) {
+    if (!good[i]) continue;
+    if (n != i) {
+      perLS.run[n] = perLS.run[i];
+      perLS.fill[n] = perLS.fill[i];
+      perLS.ls[n] = perLS.ls[i];
+      perLS.cmsls[n] = perLS.cmsls[i];
+      perLS.delivered[n] = perLS.delivered[i];
+      perLS.recorded[n] = perLS.recorded[i];
+      std::memcpy(data.row(n), data.row(i), bxStride*sizeof(float));
+    }
+    ++n;
+  }
+  perLS.run.resize(n);
+  perLS.fill.resize(n);
+  perLS.ls.resize(n);
+  perLS.cmsls.resize(n);
+  perLS.delivered.resize(n);
+  perLS.recorded.resize(n);
+  data.bx.resize(n*bxStride);
+}
+
+// Reads the brilcalc --xing csv file into data. Returns false if it can't be opened.
+inline bool readBrilcalcXing(const char *fileName, BunchLumiData &data, int nThreads = 0) {
+  data.clear();
+  MappedFile file(fileName);
+  if (!file.isOpen()) {
+    std::cerr << "ERROR: cannot open csv file: " << fileName << std::endl;
+    return false;
+  }
+  parseBrilcalcXing(file.contents(), data, nThreads);
+  return true;
+}
+
+// Same as readBrilcalcXing, but going through the cache in <file>.lumicache like loadBrilcalcByLS (see
+// LumiCache.h), with the whole LS x BX matrix cached along with the per-LS columns. These are by far the
+// biggest csv files, so this is where the cache saves the most.
+inline bool loadBrilcalcXing(const char *fileName, BunchLumiData &data, int nThreads = 0) {
+  data.clear();
+  MappedFile file(fileName);
+  if (!file.isOpen()) {
+    std::cerr << "ERROR: cannot open csv file: " << fileName << std::endl;
+    return false;
+  }
+  const uint64_t hash = hashContents(file.contents());
+  const std::string cacheName = lumiCacheName(fileName);
+  if (readLumiCache(cacheName, hash, file.size(), data.perLS, bxStride, &data.bx)) return true;
+
+  parseBrilcalcXing(file.contents(), data, nThreads);
+  if (!writeLumiCache(cacheName, hash, file.size(), data.perLS, data.bx.data(), bxStride))
+    std::cerr << "Warning: cannot write cache file " << cacheName << std::endl;
+  return true;
+}
+
+} // namespace brilcsv
+
+#endif
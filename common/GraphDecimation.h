@@ -0,0 +1,60 @@
+// Decimation of (x, y) series for plotting. When a graph has many more points than there are pixels across
+// the pad, drawing it with a line just paints the same pixel columns over and over, but it still makes the
+// rendering slow and the PDF huge. decimateMinMax splits the x range into one bucket per pixel column and
+// keeps only the first, minimum, maximum, and last point of each bucket (in their original order), which
+// draws the same envelope: any spike or dropout (such as the zeroed fire-alarm period in fill 6868) is still
+// visible, since its extreme point is always kept.
+
+#ifndef PAPERPLOTS_GRAPHDECIMATION_H
+#define PAPERPLOTS_GRAPHDECIMATION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace brilcsv {
+
+// Decimates the n points (x[i], y[i]), which must be sorted in x, into outX/outY (which are cleared first)
+// using nBuckets buckets spanning [xmin, xmax]. Points outside [xmin, xmax] are dropped, so you can use this
+// to re-decimate a zoomed-in range (like an inset) from the full-resolution data. If there are fewer than
+// 4*nBuckets points in the range, they're all kept.
+inline void decimateMinMax(const float *x, const float *y, size_t n, double xmin, double xmax, int nBuckets,
+			   std::vector<float> &outX, std::vector<float> &outY) {
+  outX.clear();
+  outY.clear();
+  const size_t begin = std::lower_bound(x, x+n, xmin) - x;
+  const size_t end = std::upper_bound(x, x+n, xmax) - x;
+  if (begin >= end) return;
+  if (nBuckets <= 0 || end - begin <= 4*static_cast<size_t>(nBuckets)) {
+    outX.assign(x+begin, x+end);
+    outY.assign(y+begin, y+end);
+    return;
+  }
+
+  outX.reserve(4*nBuckets);
+  outY.reserve(4*nBuckets);
+  const double scale = nBuckets/(xmax - xmin);
+  size_t i = begin;
+  while (i < end) {
+    // Find the end of the bucket this point is in.
+    const int bucket = std::min(nBuckets-1, static_cast<int>((x[i] - xmin)*scale));
+    size_t first = i, last = i, imin = i, imax = i;
+    for (++i; i < end && std::min(nBuckets-1, static_cast<int>((x[i] - xmin)*scale)) == bucket; ++i) {
+      last = i;
+      if (y[i] < y[imin]) imin = i;
+      if (y[i] > y[imax]) imax = i;
+    }
+    // Output the (up to) four points in order, without duplicates.
+    size_t keep[4] = {first, std::min(imin, imax), std::max(imin, imax), last};
+    for (int k=0; k<4; ++k) {
+      if (k > 0 && keep[k] == keep[k-1]) continue;
+      outX.push_back(x[keep[k]]);
+      outY.push_back(y[keep[k]]);
+    }
+  }
+}
+
+} // namespace brilcsv
+
+#endif
@@ -0,0 +1,219 @@
+// Incremental weighted least-squares straight-line fit, for fits like the HF aging one that are redone every
+// time a few more rows are appended to the csv file. A straight-line fit y = p0 + p1*x with weights
+// w = 1/sigma^2 only depends on the sums of w, wx, wy, wx^2 and wxy, so we keep those sums (LinearFitSums)
+// and add each new point to them, and the parameters and their errors can be worked out from the sums at any
+// point in O(1). This gives the same result as TGraphErrors::Fit("pol1") with errors in y only (which is
+// also a linear least-squares fit, so there's no iteration involved there either), including the errors on
+// the parameters: like ROOT for a graph with errors, they take the errors on the points at face value.
+//
+// updateLinearFitFromCSV keeps the sums in <file>.fitstate next to the csv, together with the position in
+// the csv up to which they've been filled, so each update only parses the rows appended since the last one.
+// If the csv has been changed other than by appending to it (detected from the inode number, which changes
+// when an editor or script writes a new file, and hashes of the start and end of the part already read), or
+// the fit range or columns are different, it starts again from the beginning.
+
+#ifndef PAPERPLOTS_INCREMENTALFIT_H
+#define PAPERPLOTS_INCREMENTALFIT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "BrilcalcCSV.h"
+#include "LumiCache.h"
+
+namespace brilcsv {
+
+struct LinearFitSums {
+  double sw = 0;
+  double swx = 0;
+  double swy = 0;
+  double swxx = 0;
+  double swxy = 0;
+  double swyy = 0; // only needed for the chi2
+  uint64_t n = 0;
+
+  void add(double x, double y, double sigma) {
+    const double w = 1/(sigma*sigma);
+    sw += w;
+    swx += w*x;
+    swy += w*y;
+    swxx += w*x*x;
+    swxy += w*x*y;
+    swyy += w*y*y;
+    ++n;
+  }
+};
+
+struct LinearFitResult {
+  double p0 = 0, p1 = 0;       // intercept and slope
+  double p0Err = 0, p1Err = 0;
+  double cov01 = 0;            // covariance of p0 and p1
+  double chi2 = 0;
+  int ndf = 0;
+  bool valid = false;          // false if there aren't at least two distinct x values
+
+  // Factor to multiply the errors by to scale them to the observed scatter, sqrt(chi2/ndf).
+  double errorScale() const { return ndf > 0 ? std::sqrt(chi2/ndf) : 1; }
+};
+
+// Solves the normal equations for the fit. The errors are the ones from the covariance matrix, i.e. taking
+// the errors on the points at face value, as TGraphErrors::Fit does; they are not scaled by sqrt(chi2/ndf)
+// (use errorScale() for that).
+inline LinearFitResult solveLinearFit(const LinearFitSums &s) {
+  LinearFitResult r;
+  const double det = s.sw*s.swxx - s.swx*s.swx;
+  if (s.n < 2 || !(det > 0)) return r;
+  r.p1 = (s.sw*s.swxy - s.swx*s.swy)/det;
+  r.p0 = (s.swxx*s.swy - s.swx*s.swxy)/det;
+  r.p0Err = std::sqrt(s.swxx/det);
+  r.p1Err = std::sqrt(s.sw/det);
+  r.cov01 = -s.swx/det;
+  r.chi2 = std::max(0.0, s.swyy - 2*r.p0*s.swy - 2*r.p1*s.swxy + r.p0*r.p0*s.sw + 2*r.p0*r.p1*s.swx + r.p1*r.p1*s.swxx);
+  r.ndf = s.n - 2;
+  r.valid = true;
+  return r;
+}
+
+// Fit of the points with x in [xmin, xmax] (like the range given to TGraph::Fit). Points outside the range
+// or without a positive error are ignored.
+class IncrementalLinearFit {
+public:
+  IncrementalLinearFit(double xmin, double xmax) : xmin_(xmin), xmax_(xmax) {}
+
+  bool add(double x, double y, double sigma) {
+    if (!(x >= xmin_ && x <= xmax_ && sigma > 0)) return false;
+    sums_.add(x, y, sigma);
+    return true;
+  }
+  LinearFitResult result() const { return solveLinearFit(sums_); }
+
+  double xmin() const { return xmin_; }
+  double xmax() const { return xmax_; }
+  const LinearFitSums& sums() const { return sums_; }
+  void setSums(const LinearFitSums &sums) { sums_ = sums; }
+
+private:
+  double xmin_, xmax_;
+  LinearFitSums sums_;
+};
+
+struct FitStateHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t columns[4];    // nFields, xColumn, yColumn, errColumn
+  double xmin, xmax;
+  uint64_t offset;       // the sums include every complete line before this position in the csv
+  uint64_t inode;        // inode of the csv, which changes if it is replaced by a new file
+  uint64_t headHash;     // hash of the first fitStateWindow bytes of the csv
+  uint64_t tailHash;     // hash of the fitStateWindow bytes before offset
+  LinearFitSums sums;
+};
+
+static const char fitStateMagic[8] = {'P', 'P', 'F', 'I', 'T', 'S', 'T', 0};
+static const uint32_t fitStateVersion = 1;
+static const uint64_t fitStateWindow = 4096;
+
+inline std::string fitStateName(const char *fileName) {
+  return std::string(fileName) + ".fitstate";
+}
+
+// Fills in the inode and hashes for the csv file as read up to state.offset.
+inline void fillFitStateChecks(const char *fileName, std::string_view contents, FitStateHeader &state) {
+  struct stat st;
+  state.inode = (stat(fileName, &st) == 0) ? st.st_ino : 0;
+  state.headHash = hashContents(contents.substr(0, std::min(state.offset, fitStateWindow)));
+  const uint64_t begin = (state.offset > fitStateWindow) ? state.offset - fitStateWindow : 0;
+  state.tailHash = hashContents(contents.substr(begin, state.offset - begin));
+}
+
+// Reads the saved state. Returns false if there isn't one, or it doesn't match this csv file and fit.
+inline bool readFitState(const std::string &stateName, const char *fileName, std::string_view contents,
+			 const FitStateHeader &want, FitStateHeader &state) {
+  FILE *f = fopen(stateName.c_str(), "rb");
+  if (!f) return false;
+  bool good = fread(&state, sizeof(state), 1, f) == 1;
+  fclose(f);
+  good = good && std::memcmp(state.magic, fitStateMagic, sizeof(fitStateMagic)) == 0 && state.version == fitStateVersion &&
+    std::memcmp(state.columns, want.columns, sizeof(want.columns)) == 0 && state.xmin == want.xmin && state.xmax == want.xmax &&
+    state.offset <= contents.size();
+  if (!good) return false;
+  FitStateHeader check = state;
+  fillFitStateChecks(fileName, contents, check);
+  return check.inode == state.inode && check.headHash == state.headHash && check.tailHash == state.tailHash;
+}
+
+// Writes the state to a temporary file and renames it, as for the lumi cache.
+inline bool writeFitState(const std::string &stateName, const FitStateHeader &state) {
+  std::string tempName = stateName + ".tmp" + std::to_string(::getpid());
+  FILE *f = fopen(tempName.c_str(), "wb");
+  if (!f) return false;
+  bool good = fwrite(&state, sizeof(state), 1, f) == 1;
+  good = (fclose(f) == 0) && good;
+  if (good) good = (std::rename(tempName.c_str(), stateName.c_str()) == 0);
+  if (!good) std::remove(tempName.c_str());
+  return good;
+}
+
+// Brings fit up to date with the csv file (nFields fields per line; x, y and the error on y in the given
+// columns), reading only the rows appended since the last call. A partial last line (one that's still being
+// written) is left for next time. nNewRows, if given, is set to the number of rows read. Returns false if the
+// file can't be opened.
+inline bool updateLinearFitFromCSV(const char *fileName, int nFields, int xColumn, int yColumn, int errColumn,
+				   IncrementalLinearFit &fit, size_t *nNewRows = nullptr) {
+  MappedFile file(fileName);
+  if (!file.isOpen()) {
+    std::cerr << "ERROR: cannot open csv file: " << fileName << std::endl;
+    return false;
+  }
+  std::string_view contents = file.contents();
+
+  FitStateHeader state{};
+  std::memcpy(state.magic, fitStateMagic, sizeof(fitStateMagic));
+  state.version = fitStateVersion;
+  state.columns[0] = nFields;
+  state.columns[1] = xColumn;
+  state.columns[2] = yColumn;
+  state.columns[3] = errColumn;
+  state.xmin = fit.xmin();
+  state.xmax = fit.xmax();
+
+  const std::string stateName = fitStateName(fileName);
+  FitStateHeader saved;
+  if (readFitState(stateName, fileName, contents, state, saved)) {
+    state.offset = saved.offset;
+    state.sums = saved.sums;
+  }
+  fit.setSums(state.sums);
+
+  // Only read up to the end of the last complete line.
+  const size_t lastNewline = contents.rfind('\n');
+  const uint64_t end = (lastNewline == std::string_view::npos) ? 0 : lastNewline + 1;
+  size_t nRows = 0;
+  if (end > state.offset) {
+    forEachCSVRow(contents.substr(state.offset, end - state.offset), nFields, {xColumn, yColumn, errColumn},
+		  [&](const float *row) {
+		    fit.add(row[0], row[1], row[2]);
+		    ++nRows;
+		  });
+    state.offset = end;
+  }
+  if (nNewRows) *nNewRows = nRows;
+
+  state.sums = fit.sums();
+  fillFitStateChecks(fileName, contents, state);
+  if (!writeFitState(stateName, state))
+    std::cerr << "Warning: cannot write fit state file " << stateName << std::endl;
+  return true;
+}
+
+} // namespace brilcsv
+
+#endif
@@ -0,0 +1,151 @@
+// Binary cache for the per-LS brilcalc data. The first time a csv file is read, the parsed columns are
+// written to <file>.lumicache next to it, together with a hash of the csv contents; after that the columns
+// are loaded straight from the cache, which is just a small header followed by the raw column arrays. The
+// cache is rebuilt automatically if the csv changes (i.e. if its hash no longer matches). Hashing the csv
+// is much cheaper than parsing it, so this makes rerunning a macro on year-scale data (to tweak a cosmetic
+// setting, say) much faster.
+
+#ifndef PAPERPLOTS_LUMICACHE_H
+#define PAPERPLOTS_LUMICACHE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unistd.h>
+#include "BrilcalcCSV.h"
+
+namespace brilcsv {
+
+// 64-bit hash of a block of memory, working a word at a time. This is only used to tell whether a file has
+// changed, so it doesn't need to be cryptographically strong, just fast and well-mixed.
+inline uint64_t hashContents(std::string_view contents) {
+  const uint64_t k1 = 0x87c37b91114253d5ULL;
+  const uint64_t k2 = 0x4cf5ad432745937fULL;
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ contents.size();
+  const char *p = contents.data();
+  size_t n = contents.size();
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t w;
+    std::memcpy(&w, p, 8);
+    w *= k1;
+    w = (w << 31) | (w >> 33);
+    h = ((h ^ w) * k2) + 0x52dce729;
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, p, n);
+  h ^= tail * k1;
+  h ^= h >> 33; h *= k2; h ^= h >> 29; h *= k1; h ^= h >> 32;
+  return h;
+}
+
+struct LumiCacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t nColumns;
+  uint64_t sourceHash;
+  uint64_t sourceSize;
+  uint64_t nRows;
+};
+
+static const char lumiCacheMagic[8] = {'P', 'P', 'L', 'U', 'M', 'I', 'C', 0};
+static const uint32_t lumiCacheVersion = 1;
+static const uint32_t lumiCacheColumns = 6;
+static_assert(sizeof(int) == 4 && sizeof(float) == 4, "the cache format assumes 4-byte int and float");
+
+inline std::string lumiCacheName(const char *fileName) {
+  return std::string(fileName) + ".lumicache";
+}
+
+// Loads data from the cache file if it exists and was made from a csv with this hash and size. Returns false
+// if there's no usable cache. For the --xing files (see BunchLumi.h), each LS also has nExtra floats (its row
+// of the LS x BX matrix), which are stored after the per-LS columns and loaded into extra.
+template<typename FloatVector = std::vector<float> >
+bool readLumiCache(const std::string &cacheName, uint64_t sourceHash, uint64_t sourceSize, BrilcalcLumiData &data,
+		   uint32_t nExtra = 0, FloatVector *extra = nullptr) {
+  MappedFile cache(cacheName.c_str());
+  if (!cache.isOpen() || cache.size() < sizeof(LumiCacheHeader)) return false;
+  const char *p = cache.contents().data();
+  LumiCacheHeader header;
+  std::memcpy(&header, p, sizeof(header));
+  if (std::memcmp(header.magic, lumiCacheMagic, sizeof(lumiCacheMagic)) != 0 || header.version != lumiCacheVersion ||
+      header.nColumns != lumiCacheColumns + nExtra || header.sourceHash != sourceHash || header.sourceSize != sourceSize ||
+      cache.size() != sizeof(header) + header.nRows*header.nColumns*4)
+    return false;
+
+  const size_t n = header.nRows;
+  p += sizeof(header);
+  auto load = [&](auto &column) {
+    column.resize(n);
+    std::memcpy(column.data(), p, n*4);
+    p += n*4;
+  };
+  load(data.run);
+  load(data.fill);
+  load(data.ls);
+  load(data.cmsls);
+  load(data.delivered);
+  load(data.recorded);
+  if (extra) {
+    extra->resize(n*nExtra);
+    std::memcpy(extra->data(), p, n*nExtra*4);
+  }
+  return true;
+}
+
+// Writes the cache file, with nExtra floats per LS from extra after the columns if given. It's written to a
+// temporary file first and then renamed, so that anyone else reading the cache at the same time never sees a
+// partial file. Returns false if it can't be written.
+inline bool writeLumiCache(const std::string &cacheName, uint64_t sourceHash, uint64_t sourceSize, const BrilcalcLumiData &data,
+			   const float *extra = nullptr, uint32_t nExtra = 0) {
+  std::string tempName = cacheName + ".tmp" + std::to_string(::getpid());
+  FILE *f = fopen(tempName.c_str(), "wb");
+  if (!f) return false;
+
+  LumiCacheHeader header;
+  std::memcpy(header.magic, lumiCacheMagic, sizeof(lumiCacheMagic));
+  header.version = lumiCacheVersion;
+  header.nColumns = lumiCacheColumns + (extra ? nExtra : 0);
+  header.sourceHash = sourceHash;
+  header.sourceSize = sourceSize;
+  header.nRows = data.size();
+  const size_t n = data.size();
+  bool good = fwrite(&header, sizeof(header), 1, f) == 1;
+  good = good && fwrite(data.run.data(), 4, n, f) == n;
+  good = good && fwrite(data.fill.data(), 4, n, f) == n;
+  good = good && fwrite(data.ls.data(), 4, n, f) == n;
+  good = good && fwrite(data.cmsls.data(), 4, n, f) == n;
+  good = good && fwrite(data.delivered.data(), 4, n, f) == n;
+  good = good && fwrite(data.recorded.data(), 4, n, f) == n;
+  if (extra) good = good && fwrite(extra, 4, n*nExtra, f) == n*nExtra;
+  good = (fclose(f) == 0) && good;
+  if (good) good = (std::rename(tempName.c_str(), cacheName.c_str()) == 0);
+  if (!good) std::remove(tempName.c_str());
+  return good;
+}
+
+// Same as readBrilcalcByLS, but going through the cache as described above. If the cache can't be written
+// (e.g. because the directory isn't writable), this prints a warning and carries on with the parsed data.
+inline bool loadBrilcalcByLS(const char *fileName, BrilcalcLumiData &data) {
+  data.clear();
+  MappedFile file(fileName);
+  if (!file.isOpen()) {
+    std::cerr << "ERROR: cannot open csv file: " << fileName << std::endl;
+    return false;
+  }
+  const uint64_t hash = hashContents(file.contents());
+  const std::string cacheName = lumiCacheName(fileName);
+  if (readLumiCache(cacheName, hash, file.size(), data)) return true;
+
+  parseBrilcalcByLS(file.contents(), data);
+  if (!writeLumiCache(cacheName, hash, file.size(), data))
+    std::cerr << "Warning: cannot write cache file " << cacheName << std::endl;
+  return true;
+}
+
+} // namespace brilcsv
+
+#endif
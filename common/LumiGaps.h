@@ -0,0 +1,249 @@
+// Handling of gaps in the per-LS luminosity time series: periods with missing or bad data (like the fire
+// alarm in fill 6868, or the missing chunk of PCC data in fill 6016) that we don't want to draw as a line
+// across the gap, and long periods with nothing interesting in them that we want to cut out of the x axis
+// entirely. All the positions here are LS numbers on the common LS axis (i.e. the LS numbers from LSIndex,
+// counting from the beginning of the fill), not run/LS.
+//
+// The gaps can be given explicitly, read from a json file in the same format as vdm2018.json (using
+// rangesFromMask), or found automatically with findMissingRanges and findLowRanges. layoutSeries then makes
+// a single pass over each luminometer's data to drop the cut and excluded LS, map the rest onto the broken
+// axis, and split it into segments wherever there's a gap, without copying the data per segment. The ROOT
+// side (making the graphs and drawing the broken axis) is in BrokenAxisPlot.h.
+
+#ifndef PAPERPLOTS_LUMIGAPS_H
+#define PAPERPLOTS_LUMIGAPS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+#include "LumiMerge.h"
+#include "LumiMask.h"
+
+namespace brilcsv {
+
+// An inclusive range of LS numbers.
+struct LSRange {
+  int first;
+  int last;
+};
+
+// Sorts the ranges and merges any that overlap or touch.
+inline void normalizeRanges(std::vector<LSRange> &ranges) {
+  std::sort(ranges.begin(), ranges.end(), [](const LSRange &a, const LSRange &b) { return a.first < b.first; });
+  size_t n = 0;
+  for (size_t i=0; i<ranges.size(); ++i) {
+    if (ranges[i].last < ranges[i].first) continue;
+    if (n > 0 && ranges[i].first <= ranges[n-1].last + 1)
+      ranges[n-1].last = std::max(ranges[n-1].last, ranges[i].last);
+    else
+      ranges[n++] = ranges[i];
+  }
+  ranges.resize(n);
+}
+
+// Walks through a sorted, normalized list of ranges in step with a sorted sequence of LS numbers, so that
+// checking whether each LS is in one of the ranges is O(1) amortized.
+class RangeCursor {
+public:
+  explicit RangeCursor(const std::vector<LSRange> &ranges) : ranges_(ranges) {}
+  bool contains(float ls) {
+    while (next_ < ranges_.size() && ranges_[next_].last < ls) ++next_;
+    return next_ < ranges_.size() && ranges_[next_].first <= ls;
+  }
+private:
+  const std::vector<LSRange> &ranges_;
+  size_t next_ = 0;
+};
+
+// Converts a run/LS mask (e.g. read from a json file like vdm2018.json) to ranges on the common LS axis,
+// i.e. of positions in reference, the luminometer that defines the LS numbering. Like everywhere else the
+// mask is used (see LumiMask.h), the LS numbers in the json are CMS LS numbers, so this selects the same LS
+// as computeCrossDetector does with the same json file. Parts of the mask that aren't in the reference are
+// ignored.
+inline std::vector<LSRange> rangesFromMask(const LumiMask &mask, const BrilcalcLumiData &reference) {
+  std::vector<unsigned char> selected;
+  mask.select(reference.run, reference.cmsls, selected);
+  std::vector<LSRange> ranges;
+  for (size_t i=0; i<selected.size(); ++i) {
+    if (!selected[i]) continue;
+    const int lsnum = i;
+    if (!ranges.empty() && ranges.back().last == lsnum - 1)
+      ranges.back().last = lsnum;
+    else
+      ranges.push_back({lsnum, lsnum});
+  }
+  return ranges;
+}
+
+// Finds the ranges of at least minLength LS between x.front() and x.back() that are missing from x (which
+// must be sorted).
+inline std::vector<LSRange> findMissingRanges(const std::vector<float> &x, int minLength) {
+  std::vector<LSRange> ranges;
+  for (size_t i=1; i<x.size(); ++i) {
+    int first = static_cast<int>(x[i-1]) + 1;
+    int last = static_cast<int>(x[i]) - 1;
+    if (last - first + 1 >= std::max(minLength, 1)) ranges.push_back({first, last});
+  }
+  return ranges;
+}
+
+// Finds the ranges of at least minLength consecutive points where y is below fraction times the maximum of
+// y, or isn't a number at all. This is meant for finding periods like the fire alarm, where the data are
+// there but meaningless, from a luminometer that otherwise covers the whole fill.
+inline std::vector<LSRange> findLowRanges(const std::vector<float> &x, const std::vector<float> &y, float fraction,
+					  int minLength) {
+  std::vector<LSRange> ranges;
+  float ymax = 0;
+  for (float v : y) if (std::isfinite(v)) ymax = std::max(ymax, v);
+  const float threshold = fraction*ymax;
+  size_t start = 0;
+  bool inRange = false;
+  for (size_t i=0; i<=x.size(); ++i) {
+    bool low = (i < x.size()) && !(y[i] >= threshold);
+    if (low && !inRange) {
+      start = i;
+      inRange = true;
+    } else if (!low && inRange) {
+      if (static_cast<int>(i - start) >= minLength) ranges.push_back({static_cast<int>(x[start]), static_cast<int>(x[i-1])});
+      inRange = false;
+    }
+  }
+  return ranges;
+}
+
+// Turns a list of bad ranges into cuts for the x axis: each bad range longer than minCutLength has margin LS
+// kept at either end (so you can still see the data dropping out on either side of the cut) and the rest is
+// cut.
+inline std::vector<LSRange> cutsFromBadRanges(const std::vector<LSRange> &bad, int margin, int minCutLength) {
+  std::vector<LSRange> cuts;
+  for (const LSRange &r : bad) {
+    LSRange cut = {r.first + margin, r.last - margin};
+    if (cut.last - cut.first + 1 >= minCutLength) cuts.push_back(cut);
+  }
+  return cuts;
+}
+
+// The LS axis with some ranges cut out of it. LS after a cut are shifted left by the length of the cut, so
+// that the LS after the cut is drawn right after the LS before it.
+class BrokenLSAxis {
+public:
+  BrokenLSAxis() {}
+  explicit BrokenLSAxis(std::vector<LSRange> cuts) : cuts_(cuts) {
+    normalizeRanges(cuts_);
+    shift_.resize(cuts_.size());
+    int total = 0;
+    for (size_t i=0; i<cuts_.size(); ++i) {
+      total += cuts_[i].last - cuts_[i].first + 1;
+      shift_[i] = total;
+    }
+  }
+
+  const std::vector<LSRange>& cuts() const { return cuts_; }
+
+  bool isCut(float ls) const {
+    size_t i = upperCut(ls);
+    return i > 0 && ls <= cuts_[i-1].last;
+  }
+
+  // Position on the displayed axis of a (non-cut) LS.
+  float toDisplay(float ls) const {
+    size_t i = upperCut(ls);
+    return (i > 0) ? ls - shift_[i-1] : ls;
+  }
+
+  // Display position of the break for each cut (between the last LS before it and the first LS after it).
+  float breakPosition(size_t i) const { return cuts_[i].first - (i > 0 ? shift_[i-1] : 0) - 0.5; }
+
+  // The parts of [lsMin, lsMax] that aren't cut, in true LS numbers.
+  std::vector<LSRange> visibleRanges(int lsMin, int lsMax) const {
+    std::vector<LSRange> visible;
+    int start = lsMin;
+    for (const LSRange &c : cuts_) {
+      if (c.last < start) continue;
+      if (c.first > lsMax) break;
+      if (c.first > start) visible.push_back({start, c.first - 1});
+      start = c.last + 1;
+    }
+    if (start <= lsMax) visible.push_back({start, lsMax});
+    return visible;
+  }
+
+private:
+  // Index of the first cut starting after ls.
+  size_t upperCut(float ls) const {
+    return std::upper_bound(cuts_.begin(), cuts_.end(), ls, [](float v, const LSRange &r) { return v < r.first; }) - cuts_.begin();
+  }
+
+  std::vector<LSRange> cuts_;
+  std::vector<int> shift_;
+};
+
+// One luminometer's data laid out on a broken axis: x is in display coordinates, and segment k consists of
+// the points [segmentStart[k], segmentStart[k+1]), where the last entry of segmentStart is x.size().
+struct SegmentedSeries {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<size_t> segmentStart;
+
+  size_t nSegments() const { return segmentStart.empty() ? 0 : segmentStart.size() - 1; }
+  size_t segmentSize(size_t k) const { return segmentStart[k+1] - segmentStart[k]; }
+  const float *segmentX(size_t k) const { return x.data() + segmentStart[k]; }
+  const float *segmentY(size_t k) const { return y.data() + segmentStart[k]; }
+};
+
+// Sorts (x, y) by x if it isn't sorted already.
+template <typename X>
+void sortByX(std::vector<X> &x, std::vector<float> &y) {
+  if (std::is_sorted(x.begin(), x.end())) return;
+  std::vector<size_t> order(x.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return x[a] < x[b]; });
+  std::vector<X> sx(x.size());
+  std::vector<float> sy(y.size());
+  for (size_t i=0; i<order.size(); ++i) {
+    sx[i] = x[order[i]];
+    sy[i] = y[order[i]];
+  }
+  x.swap(sx);
+  y.swap(sy);
+}
+
+// Starts a new segment at the first point at or after display position x, if one doesn't start there
+// already, for when a line should be broken somewhere other than at a gap in the data.
+inline void splitSegmentsAt(SegmentedSeries &series, float x) {
+  const size_t i = std::lower_bound(series.x.begin(), series.x.end(), x) - series.x.begin();
+  if (i == 0 || i == series.x.size()) return;
+  auto it = std::lower_bound(series.segmentStart.begin(), series.segmentStart.end(), i);
+  if (*it != i) series.segmentStart.insert(it, i);
+}
+
+// Lays out one luminometer's data (x = LS number, sorted) on the broken axis in a single pass: points in an
+// axis cut or in one of the excluded ranges are dropped, points in one of the zeroed ranges are set to zero
+// (so they're drawn as a dropout), and a new segment is started wherever consecutive points are more than
+// maxStep LS apart on the displayed axis.
+inline void layoutSeries(const std::vector<float> &x, const std::vector<float> &y, const BrokenLSAxis &axis,
+			 const std::vector<LSRange> &zeroed, const std::vector<LSRange> &excluded, int maxStep,
+			 SegmentedSeries &out) {
+  out.x.clear();
+  out.y.clear();
+  out.segmentStart.clear();
+  out.x.reserve(x.size());
+  out.y.reserve(y.size());
+
+  RangeCursor cut(axis.cuts()), zero(zeroed), exclude(excluded);
+  for (size_t i=0; i<x.size(); ++i) {
+    if (cut.contains(x[i]) || exclude.contains(x[i])) continue;
+    float dx = axis.toDisplay(x[i]);
+    if (out.x.empty() || dx - out.x.back() > maxStep) out.segmentStart.push_back(out.x.size());
+    out.x.push_back(dx);
+    out.y.push_back(zero.contains(x[i]) ? 0 : y[i]);
+  }
+  out.segmentStart.push_back(out.x.size());
+  if (out.x.empty()) out.segmentStart.clear();
+}
+
+} // namespace brilcsv
+
+#endif
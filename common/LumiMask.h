@@ -0,0 +1,154 @@
+// Run/LS masks in the usual CMS json format ({"run": [[firstLS, lastLS], ...], ...}, like vdm2018.json or
+// a golden json), and a filter that applies one to the columns read by BrilcalcCSV.h. The ranges are in
+// CMS LS numbers and inclusive, like brilcalc -i.
+
+#ifndef PAPERPLOTS_LUMIMASK_H
+#define PAPERPLOTS_LUMIMASK_H
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BrilcalcCSV.h"
+#include "LumiMerge.h"
+
+namespace brilcsv {
+
+class LumiMask {
+public:
+  struct Range {
+    int run;
+    int firstLS;
+    int lastLS;
+  };
+
+  // Reads the mask from a json file. Returns false (and prints the problem) if the file can't be read or
+  // isn't in the expected format.
+  bool read(const char *fileName) {
+    ranges_.clear();
+    MappedFile file(fileName);
+    if (!file.isOpen()) {
+      std::cerr << "ERROR: cannot open json file: " << fileName << std::endl;
+      return false;
+    }
+    Parser p{file.contents(), 0};
+    bool good = p.expect('{');
+    if (good && !p.peek('}')) {
+      do {
+	int run;
+	good = p.quotedInt(run) && p.expect(':') && p.expect('[');
+	if (good && !p.peek(']')) {
+	  do {
+	    Range r;
+	    r.run = run;
+	    good = p.expect('[') && p.integer(r.firstLS) && p.expect(',') && p.integer(r.lastLS) && p.expect(']');
+	    if (good) ranges_.push_back(r);
+	  } while (good && p.accept(','));
+	}
+	good = good && p.expect(']');
+      } while (good && p.accept(','));
+    }
+    good = good && p.expect('}');
+    if (!good) {
+      std::cerr << "ERROR: malformed json file: " << fileName << " (at character " << p.pos << ")" << std::endl;
+      ranges_.clear();
+      return false;
+    }
+    std::sort(ranges_.begin(), ranges_.end(), [](const Range &a, const Range &b) {
+      return packRunLS(a.run, a.firstLS) < packRunLS(b.run, b.firstLS);
+    });
+    return true;
+  }
+
+  const std::vector<Range>& ranges() const { return ranges_; }
+
+  bool contains(int run, int ls) const {
+    const uint64_t key = packRunLS(run, ls);
+    auto it = std::upper_bound(ranges_.begin(), ranges_.end(), key, [](uint64_t k, const Range &r) {
+      return k < packRunLS(r.run, r.firstLS);
+    });
+    // Ranges could in principle overlap, so check back until we're in an earlier run.
+    while (it != ranges_.begin()) {
+      --it;
+      if (it->run != run) break;
+      if (ls <= it->lastLS) return true;
+    }
+    return false;
+  }
+
+  // Sets selected[i] to 1 if (run[i], ls[i]) is in the mask and 0 otherwise. Since brilcalc output is
+  // sorted by run and LS, this is normally a single merge-like pass over the data and the ranges; if the
+  // data isn't sorted, it falls back to a binary search per LS.
+  void select(const std::vector<int> &run, const std::vector<int> &ls, std::vector<unsigned char> &selected) const {
+    const size_t n = run.size();
+    selected.assign(n, 0);
+    if (ranges_.empty() || n == 0) return;
+
+    std::vector<uint64_t> keys(n);
+    for (size_t i=0; i<n; ++i) keys[i] = packRunLS(run[i], ls[i]);
+    if (!std::is_sorted(keys.begin(), keys.end()) || overlapping()) {
+      for (size_t i=0; i<n; ++i) selected[i] = contains(run[i], ls[i]);
+      return;
+    }
+    size_t i = 0;
+    for (const Range &r : ranges_) {
+      const uint64_t first = packRunLS(r.run, r.firstLS);
+      const uint64_t last = packRunLS(r.run, r.lastLS);
+      i = std::lower_bound(keys.begin() + i, keys.end(), first) - keys.begin();
+      size_t end = std::upper_bound(keys.begin() + i, keys.end(), last) - keys.begin();
+      std::fill(selected.begin() + i, selected.begin() + end, 1);
+      i = end;
+    }
+  }
+
+private:
+  bool overlapping() const {
+    for (size_t i=1; i<ranges_.size(); ++i)
+      if (ranges_[i].run == ranges_[i-1].run && ranges_[i].firstLS <= ranges_[i-1].lastLS) return true;
+    return false;
+  }
+
+  // Just enough of a json parser for this format.
+  struct Parser {
+    std::string_view text;
+    size_t pos;
+
+    void skipSpace() { while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos]))) ++pos; }
+    bool peek(char c) { skipSpace(); return pos < text.size() && text[pos] == c; }
+    bool accept(char c) { if (!peek(c)) return false; ++pos; return true; }
+    bool expect(char c) { return accept(c); }
+    bool integer(int &value) {
+      skipSpace();
+      auto res = std::from_chars(text.data() + pos, text.data() + text.size(), value);
+      if (res.ec != std::errc()) return false;
+      pos = res.ptr - text.data();
+      return true;
+    }
+    bool quotedInt(int &value) { return expect('"') && integer(value) && expect('"'); }
+  };
+
+  std::vector<Range> ranges_;
+};
+
+// Sum of values[i] for which selected[i] is set. This is branch-free and keeps four partial sums, so the
+// compiler can vectorize it without needing -ffast-math.
+inline double maskedSum(const std::vector<float> &values, const std::vector<unsigned char> &selected) {
+  const size_t n = values.size();
+  const float *v = values.data();
+  const unsigned char *s = selected.data();
+  double sum[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i+4<=n; i+=4)
+    for (int k=0; k<4; ++k)
+      sum[k] += s[i+k] * static_cast<double>(v[i+k]);
+  for (; i<n; ++i)
+    sum[0] += s[i] * static_cast<double>(v[i]);
+  return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+}
+
+} // namespace brilcsv
+
+#endif
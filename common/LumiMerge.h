@@ -0,0 +1,99 @@
+// Helpers for reading the csv files for several luminometers at once and putting them on a common LS
+// axis. The files are parsed concurrently on a small pool of threads, and the run/LS -> LS number lookup
+// uses a sorted array of packed (run<<32 | ls) keys instead of a std::map of strings, so that looking up
+// the LSes for the other luminometers is cheap and can be done from several threads without locking.
+
+#ifndef PAPERPLOTS_LUMIMERGE_H
+#define PAPERPLOTS_LUMIMERGE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BrilcalcCSV.h"
+#include "LumiCache.h"
+
+namespace brilcsv {
+
+inline uint64_t packRunLS(int run, int ls) {
+  return (static_cast<uint64_t>(static_cast<uint32_t>(run)) << 32) | static_cast<uint32_t>(ls);
+}
+
+// Calls f(i) for i in [0, n) on up to nThreads threads (0 means one per core). Each i is handled by
+// exactly one thread, so f can write to per-i output without any locking.
+template<typename F>
+inline void parallelFor(int n, F&& f, int nThreads = 0) {
+  if (nThreads <= 0) nThreads = std::max(1u, std::thread::hardware_concurrency());
+  nThreads = std::min(nThreads, n);
+  if (nThreads <= 1) {
+    for (int i=0; i<n; ++i) f(i);
+    return;
+  }
+  std::atomic<int> next(0);
+  std::vector<std::thread> workers;
+  for (int t=0; t<nThreads; ++t) {
+    workers.emplace_back([&]() {
+      for (int i = next++; i < n; i = next++) f(i);
+    });
+  }
+  for (auto &w : workers) w.join();
+}
+
+// Reads fileNames[i] into data[i], with the files parsed in parallel. If useCache is set, this goes through
+// the binary cache in LumiCache.h. Returns false if any of the files couldn't be opened.
+inline bool readBrilcalcByLSParallel(const std::vector<std::string> &fileNames, std::vector<BrilcalcLumiData> &data,
+				     bool useCache = false, int nThreads = 0) {
+  data.assign(fileNames.size(), BrilcalcLumiData());
+  std::vector<char> ok(fileNames.size(), 0);
+  parallelFor(static_cast<int>(fileNames.size()), [&](int i) {
+    if (useCache)
+      ok[i] = loadBrilcalcByLS(fileNames[i].c_str(), data[i]);
+    else
+      ok[i] = readBrilcalcByLS(fileNames[i].c_str(), data[i]);
+  }, nThreads);
+  return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
+
+// Maps run/LS to the LS number (i.e. the position in the file) in a reference luminometer.
+class LSIndex {
+public:
+  LSIndex() {}
+  explicit LSIndex(const BrilcalcLumiData &reference) { build(reference); }
+
+  void build(const BrilcalcLumiData &reference) {
+    const size_t n = reference.size();
+    keys_.resize(n);
+    lsnums_.resize(n);
+    for (size_t i=0; i<n; ++i) {
+      keys_[i] = packRunLS(reference.run[i], reference.ls[i]);
+      lsnums_[i] = i;
+    }
+    // brilcalc output is normally already in run/LS order, in which case there's nothing more to do.
+    if (!std::is_sorted(keys_.begin(), keys_.end())) {
+      std::vector<uint64_t> keys(keys_);
+      std::stable_sort(lsnums_.begin(), lsnums_.end(), [&](int a, int b) { return keys[a] < keys[b]; });
+      for (size_t i=0; i<n; ++i) keys_[i] = keys[lsnums_[i]];
+    }
+  }
+
+  // Returns the LS number for this run/LS, or -1 if it's not in the reference. If the reference has the
+  // same run/LS more than once, the last one wins.
+  int find(int run, int ls) const {
+    const uint64_t key = packRunLS(run, ls);
+    auto it = std::upper_bound(keys_.begin(), keys_.end(), key);
+    if (it == keys_.begin() || *(it-1) != key) return -1;
+    return lsnums_[it - keys_.begin() - 1];
+  }
+
+  size_t size() const { return keys_.size(); }
+
+private:
+  std::vector<uint64_t> keys_;
+  std::vector<int> lsnums_;
+};
+
+} // namespace brilcsv
+
+#endif
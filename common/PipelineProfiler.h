@@ -0,0 +1,257 @@
+// Optional timing and memory instrumentation for the plotting pipelines, to see where the time goes (reading
+// the csv files, merging them onto the common LS axis, decimating and making the graphs, fitting, or
+// printing the PDF/PNG). The pipelines wrap each stage in a StageTimer, which records the wall and CPU time,
+// the change in resident memory and (see below) the number of allocations, and at the end they call
+// Profiler::writeReport, which writes it all out as a JSON file. When profiling isn't turned on, none of this
+// does anything.
+//
+// To turn it on, set PAPERPLOTS_PROFILE in the environment, either to 1, in which case the report goes next
+// to the plot (e.g. VdMFillLumi6868_profile.json), or to the name of the JSON file to write. The batch
+// programs also have a --profile option.
+//
+// Counting allocations needs replacing the global operator new, which can only be done once per program and
+// not from inside ROOT. So this is only done in compiled programs that #define PAPERPLOTS_COUNT_ALLOCATIONS
+// before including this file (in one source file only); otherwise the allocation counts in the report are
+// null.
+
+#ifndef PAPERPLOTS_PIPELINEPROFILER_H
+#define PAPERPLOTS_PIPELINEPROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace brilcsv {
+
+struct AllocationCounter {
+  static std::atomic<long long>& count() { static std::atomic<long long> n(0); return n; }
+  static std::atomic<long long>& bytes() { static std::atomic<long long> n(0); return n; }
+  static bool& active() { static bool a = false; return a; }
+};
+
+// Resident memory of this process now, in kB.
+inline long currentRSSkB() {
+  long pages = 0, resident = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f) return 0;
+  if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+  fclose(f);
+  return resident*(sysconf(_SC_PAGESIZE)/1024);
+}
+
+// Peak resident memory of this process so far, in kB.
+inline long peakRSSkB() {
+  struct rusage usage;
+  return (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+}
+
+// CPU time used by this process (all threads), in seconds.
+inline double processCPUSeconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+class Profiler {
+public:
+  struct Stage {
+    int calls = 0;
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    long rssDeltakB = 0;
+    long long allocations = 0;
+    long long allocatedBytes = 0;
+  };
+
+  static Profiler& instance() {
+    static Profiler profiler;
+    return profiler;
+  }
+
+  bool enabled() const { return enabled_; }
+
+  // Turns profiling on (if it isn't already from the environment) and starts again from scratch. If
+  // reportName is empty, the report goes to the default name passed to writeReport.
+  void enable(const std::string &reportName = "") {
+    std::lock_guard<std::mutex> lock(mutex_);
+    enabled_ = true;
+    if (!reportName.empty()) reportName_ = reportName;
+    stages_.clear();
+    order_.clear();
+    metrics_.clear();
+    metricOrder_.clear();
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  void record(const std::string &name, const Stage &s) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stages_.find(name) == stages_.end()) order_.push_back(name);
+    Stage &total = stages_[name];
+    total.calls += s.calls;
+    total.wallSeconds += s.wallSeconds;
+    total.cpuSeconds += s.cpuSeconds;
+    total.rssDeltakB += s.rssDeltakB;
+    total.allocations += s.allocations;
+    total.allocatedBytes += s.allocatedBytes;
+  }
+
+  // Extra numbers to put in the report, like the number of LS read or points drawn.
+  void setMetric(const std::string &name, double value) {
+    if (!enabled_) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (metrics_.find(name) == metrics_.end()) metricOrder_.push_back(name);
+    metrics_[name] = value;
+  }
+
+  // Writes the JSON report for program (e.g. "makeVdMLumiPlot") to the file given in PAPERPLOTS_PROFILE or
+  // to enable, or else to defaultName. Does nothing if profiling is off. Returns false if the file can't be
+  // written.
+  bool writeReport(const std::string &program, const std::string &label, const std::string &defaultName) {
+    if (!enabled_) return true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::string fileName = reportName_.empty() ? defaultName : reportName_;
+    FILE *f = fopen(fileName.c_str(), "w");
+    if (!f) {
+      std::cerr << "ERROR: cannot write profile report: " << fileName << std::endl;
+      return false;
+    }
+    const bool counting = AllocationCounter::active();
+    auto count = [&](long long n) { return counting ? std::to_string(n) : std::string("null"); };
+    fprintf(f, "{\n");
+    fprintf(f, "  \"program\": \"%s\",\n", escape(program).c_str());
+    fprintf(f, "  \"label\": \"%s\",\n", escape(label).c_str());
+    fprintf(f, "  \"threads\": %u,\n", std::thread::hardware_concurrency());
+    fprintf(f, "  \"wall_seconds\": %.6f,\n", std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count());
+    fprintf(f, "  \"cpu_seconds\": %.6f,\n", processCPUSeconds());
+    fprintf(f, "  \"peak_rss_kb\": %ld,\n", peakRSSkB());
+    fprintf(f, "  \"allocations\": %s,\n", count(AllocationCounter::count()).c_str());
+    fprintf(f, "  \"allocated_bytes\": %s,\n", count(AllocationCounter::bytes()).c_str());
+    fprintf(f, "  \"metrics\": {");
+    for (size_t i=0; i<metricOrder_.size(); ++i)
+      fprintf(f, "%s\n    \"%s\": %.17g", i ? "," : "", escape(metricOrder_[i]).c_str(), metrics_[metricOrder_[i]]);
+    fprintf(f, "%s},\n", metricOrder_.empty() ? "" : "\n  ");
+    fprintf(f, "  \"stages\": [");
+    for (size_t i=0; i<order_.size(); ++i) {
+      const Stage &s = stages_[order_[i]];
+      fprintf(f, "%s\n    {\"name\": \"%s\", \"calls\": %d, \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f, \"rss_delta_kb\": %ld, "
+	      "\"allocations\": %s, \"allocated_bytes\": %s}", i ? "," : "", escape(order_[i]).c_str(), s.calls, s.wallSeconds,
+	      s.cpuSeconds, s.rssDeltakB, count(s.allocations).c_str(), count(s.allocatedBytes).c_str());
+    }
+    fprintf(f, "%s]\n}\n", order_.empty() ? "" : "\n  ");
+    bool good = (fclose(f) == 0);
+    if (good) std::cout << "Wrote profile report " << fileName << std::endl;
+    return good;
+  }
+
+private:
+  Profiler() : start_(std::chrono::steady_clock::now()) {
+    const char *env = getenv("PAPERPLOTS_PROFILE");
+    if (env && *env && strcmp(env, "0") != 0) {
+      enabled_ = true;
+      if (strcmp(env, "1") != 0) reportName_ = env;
+    }
+  }
+
+  static std::string escape(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+      if (c == '"' || c == '\\') out += '\\';
+      if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+    return out;
+  }
+
+  bool enabled_ = false;
+  std::string reportName_;
+  std::mutex mutex_;
+  std::map<std::string, Stage> stages_;
+  std::vector<std::string> order_;
+  std::map<std::string, double> metrics_;
+  std::vector<std::string> metricOrder_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Records the time etc. from its construction to stop() (or its destruction) as one call of the stage.
+class StageTimer {
+public:
+  explicit StageTimer(const char *name) : name_(name), running_(Profiler::instance().enabled()) {
+    if (!running_) return;
+    rss_ = currentRSSkB();
+    allocations_ = AllocationCounter::count();
+    bytes_ = AllocationCounter::bytes();
+    cpu_ = processCPUSeconds();
+    start_ = std::chrono::steady_clock::now();
+  }
+  ~StageTimer() { stop(); }
+
+  void stop() {
+    if (!running_) return;
+    running_ = false;
+    Profiler::Stage s;
+    s.calls = 1;
+    s.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    s.cpuSeconds = processCPUSeconds() - cpu_;
+    s.rssDeltakB = currentRSSkB() - rss_;
+    s.allocations = AllocationCounter::count() - allocations_;
+    s.allocatedBytes = AllocationCounter::bytes() - bytes_;
+    Profiler::instance().record(name_, s);
+  }
+
+private:
+  const char *name_;
+  bool running_;
+  long rss_ = 0;
+  long long allocations_ = 0, bytes_ = 0;
+  double cpu_ = 0;
+  std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace brilcsv
+
+#ifdef PAPERPLOTS_COUNT_ALLOCATIONS
+// The replacement operator new/delete; the array and nothrow versions all end up here too. The aligned
+// versions are replaced too, since BunchLumi.h uses those for the per-bunch matrix.
+namespace {
+struct AllocationCounterActivator {
+  AllocationCounterActivator() { brilcsv::AllocationCounter::active() = true; }
+} allocationCounterActivator;
+}
+
+void *operator new(size_t n) {
+  brilcsv::AllocationCounter::count().fetch_add(1, std::memory_order_relaxed);
+  brilcsv::AllocationCounter::bytes().fetch_add(n, std::memory_order_relaxed);
+  void *p = std::malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new(size_t n, std::align_val_t alignment) {
+  brilcsv::AllocationCounter::count().fetch_add(1, std::memory_order_relaxed);
+  brilcsv::AllocationCounter::bytes().fetch_add(n, std::memory_order_relaxed);
+  const size_t a = static_cast<size_t>(alignment);
+  void *p = std::aligned_alloc(a, (n + a - 1)/a*a);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+// These are kept out of line, since otherwise GCC sees free() called on memory from operator new and warns
+// about it.
+__attribute__((noinline)) void operator delete(void *p) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+__attribute__((noinline)) void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
+
+#endif
@@ -0,0 +1,119 @@
+// Synthetic input files for the benchmarks, in the same formats as the real ones: brilcalc lumi --byls and
+// --xing output for a fill, and the HF aging csv (like HFOCAging.csv). Everything is deterministic (no random
+// seeds from the clock), so the same arguments always give the same files and benchmark results can be
+// compared between runs and machines.
+
+#ifndef PAPERPLOTS_SYNTHETICDATA_H
+#define PAPERPLOTS_SYNTHETICDATA_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+namespace brilcsv {
+
+// Small deterministic generator for the noise, returning values in [-0.5, 0.5).
+struct SyntheticNoise {
+  explicit SyntheticNoise(uint32_t seed) : state(seed) {}
+  double next() {
+    state = state*1664525u + 1013904223u;
+    return (state >> 8)/double(1 << 24) - 0.5;
+  }
+  uint32_t state;
+};
+
+// Writes nLS lines in the same format as brilcalc lumi --byls -u hz/ub for the given fill and detector. Runs
+// are 1000 LS long, and the luminosity decays over the fill, times scale, with a little noise. Returns false
+// if the file can't be written.
+inline bool writeSyntheticByLS(const char *fileName, int nLS, int fill = 6868, const char *detector = "HFET",
+			       double scale = 1.0) {
+  FILE *f = fopen(fileName, "w");
+  if (!f) {
+    std::cerr << "ERROR: cannot write csv file: " << fileName << std::endl;
+    return false;
+  }
+  SyntheticNoise noise(fill);
+  const double lifetime = std::max(20000.0, 2.0*nLS);
+  fprintf(f, "#Data tag : 19v3 , Norm tag: None\n");
+  fprintf(f, "#run:fill,ls,time,beamstatus,E(GeV),delivered(hz/ub),recorded(hz/ub),avgpu,source\n");
+  for (int i=0; i<nLS; ++i) {
+    int run = 318000 + i/1000;
+    int ls = i%1000 + 1;
+    float lumi = scale*(8.5*exp(-i/lifetime) + 0.02*noise.next());
+    fprintf(f, "%d:%d,%d:%d,10/30/18 %02d:%02d:%02d,STABLE BEAMS,6500,%.6f,%.6f,%.1f,%s\n",
+	    run, fill, ls, ls, (i/3600)%24, (i/60)%60, i%60, lumi, 0.98*lumi, 50.0*lumi/8.5, detector);
+  }
+  fprintf(f, "#Summary:\n");
+  return fclose(f) == 0;
+}
+
+// Whether BX b (counting from 1) is colliding in the synthetic per-bunch fill: nine trains of 48 bunches,
+// two isolated bunches, and one more train that wraps around the end of the orbit (BX 3560-3564 and 1-11),
+// so BX 1 is not a leading bunch, and the last few BX (which aren't a whole SIMD vector) are filled.
+inline bool syntheticCollidingBX(int b) {
+  return (b <= 2700 && (b - 1) % 300 >= 12 && (b - 1) % 300 < 60) || b == 3000 || b == 3100 || b >= 3560 || b <= 11;
+}
+
+// Writes nLS lines in the format of brilcalc lumi --byls --xing -u hz/ub (see BunchLumi.h), with the
+// luminosity of each colliding bunch decaying over the fill like writeSyntheticByLS, times scale, with
+// bunch-to-bunch differences and a little noise. The per-LS delivered column is the sum over the bunches.
+// Returns false if the file can't be written.
+inline bool writeSyntheticXing(const char *fileName, int nLS, int fill = 7000, const char *detector = "HFET",
+			       double scale = 1.0) {
+  FILE *f = fopen(fileName, "w");
+  if (!f) {
+    std::cerr << "ERROR: cannot write csv file: " << fileName << std::endl;
+    return false;
+  }
+  SyntheticNoise noise(fill);
+  const double lifetime = std::max(20000.0, 2.0*nLS);
+  std::string bx;
+  char buf[64];
+  fprintf(f, "#Data tag : 19v3 , Norm tag: None\n");
+  fprintf(f, "#run:fill,ls,time,beamstatus,E(GeV),delivered(hz/ub),recorded(hz/ub),avgpu,source,[bxidx bxdelivered(hz/ub) bxrecorded(hz/ub)]\n");
+  for (int i=0; i<nLS; ++i) {
+    int run = 318000 + i/1000;
+    int ls = i%1000 + 1;
+    double total = 0;
+    bx.clear();
+    for (int b=1; b<=3564; ++b) {
+      if (!syntheticCollidingBX(b)) continue;
+      float lumi = scale*exp(-i/lifetime)*(0.02 + 0.002*(b%7) + 0.0002*noise.next());
+      total += lumi;
+      snprintf(buf, sizeof(buf), "%s%d %.6f %.6f", bx.empty() ? "" : " ", b, lumi, 0.98*lumi);
+      bx += buf;
+    }
+    fprintf(f, "%d:%d,%d:%d,10/30/18 %02d:%02d:%02d,STABLE BEAMS,6500,%.6f,%.6f,%.1f,%s,[%s]\n",
+	    run, fill, ls, ls, (i/3600)%24, (i/60)%60, i%60, total, 0.98*total, 50.0*total/8.5, detector, bx.c_str());
+  }
+  fprintf(f, "#Summary:\n");
+  return fclose(f) == 0;
+}
+
+// Appends rows firstRow..firstRow+nRows-1 of a synthetic aging file in the format of HFOCAging.csv: the
+// integrated luminosity goes from 90 to 165 fb^-1 over totalRows rows (so it covers the fit range in
+// makeHFAgingPlot.C), and the efficiency drops linearly with some scatter. The file is started, with the
+// header, if firstRow is 0. Returns false if the file can't be written.
+inline bool writeSyntheticAging(const char *fileName, int firstRow, int nRows, int totalRows) {
+  FILE *f = fopen(fileName, firstRow == 0 ? "w" : "a");
+  if (!f) {
+    std::cerr << "ERROR: cannot write csv file: " << fileName << std::endl;
+    return false;
+  }
+  if (firstRow == 0) fprintf(f, "fill,lumi,nbx,SBIL,SBILerr,HFOCsig,HFOC err,HFOC FOM,HFOCFOMERR\r\n");
+  SyntheticNoise noise(12345 + firstRow);
+  for (int i=firstRow; i<firstRow+nRows; ++i) {
+    double lumi = 90 + 75.0*i/totalRows;
+    double err = 0.002 + 0.002*((i*7)%5)/4.0;
+    double fom = 1.08 - 0.00085*lumi + 2*err*noise.next();
+    fprintf(f, "%d,%.3f,%d,%.6f,%.6f,%.6f,%.6f,%.9f,%.9f\r\n", 6600 + i/100, lumi, 590, 9.0, 30.0, 820.0, 2.0, fom, err);
+  }
+  return fclose(f) == 0;
+}
+
+} // namespace brilcsv
+
+#endif
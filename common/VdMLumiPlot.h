@@ -0,0 +1,560 @@
+// The read -> merge -> draw pipeline for the VdM fill luminosity plot, taken out of
+// LUM-18-002/makeVdMLumiPlot.C so that it can be run for any fill: the macros in LUM-18-002 and LUM-17-004
+// just fill in a VdMPlotConfig for fills 6868 and 6016 and call drawVdMLumiPlot, and batchVdMLumiPlots.cc
+// does the same for a whole list of fills without going through ACLiC. Everything that was hardcoded for one
+// fill (the detectors, the fire alarm period, the special handling of PCC in 2017, the shaded boxes, the
+// inset, ...) is a setting in VdMPlotConfig; see there for what they do.
+
+#ifndef PAPERPLOTS_VDMLUMIPLOT_H
+#define PAPERPLOTS_VDMLUMIPLOT_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "TBox.h"
+#include "TCanvas.h"
+#include "TColor.h"
+#include "TGraph.h"
+#include "TH1.h"
+#include "TLegend.h"
+#include "TPad.h"
+#include "TStyle.h"
+#include "TText.h"
+#include "BrilcalcCSV.h"
+#include "LumiMerge.h"
+#include "LumiMask.h"
+#include "GraphDecimation.h"
+#include "LumiGaps.h"
+#include "BrokenAxisPlot.h"
+#include "BunchLumi.h"
+#include "BunchKernels.h"
+#include "PipelineProfiler.h"
+
+namespace brilcsv {
+
+// A box to shade, from run1/ls1 to run2/ls2 (inclusive).
+struct RunLSBox {
+  int run1, ls1, run2, ls2;
+};
+
+struct VdMPlotConfig {
+  int fill = 0;
+  // Luminometers to plot. The csv files are <csvDir>/<fill>_<detector>.csv. The first one defines the LS
+  // numbering, so it should have all the LS in the fill.
+  std::vector<std::string> detectors;
+  std::vector<int> colors; // one per detector; if empty, defaultDetectorColor is used
+  std::string csvDir = ".";
+  // Output files are <outputName>.pdf and <outputName>.png; if empty, defaultOutputName is used.
+  std::string outputName;
+
+  // Gaps (see LumiGaps.h), in LS numbers since the beginning of the fill. Data in the zeroed ranges are
+  // drawn as zero and the cut ranges are removed from the x axis.
+  std::vector<LSRange> zeroedRanges;
+  std::vector<LSRange> axisCuts;
+  // A json file (same format as vdm2018.json) of bad periods, which are zeroed, and cut from the axis apart
+  // from gapMargin LS at either end if they're longer than minCutLength.
+  std::string gapFile;
+  // Find the bad periods automatically instead: periods of at least minCutLength LS where the reference
+  // luminometer is below lowFraction of its maximum are treated as if they were in gapFile.
+  bool autoGaps = false;
+  float lowFraction = 0.05;
+  int gapMargin = 50;
+  int minCutLength = 100;
+  // Lines are broken wherever a luminometer has more than this many LS missing.
+  int maxStep = 10;
+  // Special handling for single luminometers (by name), like PCC in fill 6016: LS ranges to leave out of its
+  // graph altogether, and LS where its line should be broken even though there's no gap there.
+  std::map<std::string, std::vector<LSRange> > excludedRanges;
+  std::map<std::string, std::vector<int> > splitPoints;
+
+  // Shaded boxes (e.g. the periods used for the cross-detector comparison), either explicitly or from a
+  // json file like vdm2018.json. The boxes go up to boxTop, or 5% above the highest point if it's 0. In ratio
+  // plots they cover the whole height of the frame instead.
+  std::vector<RunLSBox> boxes;
+  std::string boxFile;
+  double boxTop = 0;
+
+  // The frame: the x range (on the displayed axis, i.e. with the cuts taken out) is that of the data, unless
+  // frameXMax is set, or xRangeFromReference is, in which case it's that of the first luminometer plus 10% on
+  // either side (but not below 0). The y range goes from the lowest to the highest point plus 10%, over all
+  // the luminometers, or just the first one if yRangeFromReference is set. Taking both from the first one is
+  // what ROOT does when it's drawn with "AL" and the rest on top, as the original plots were made (not for
+  // ratio plots).
+  double frameXMin = 0, frameXMax = 0;
+  bool xRangeFromReference = false;
+  bool yRangeFromReference = false;
+  double yTitleOffset = 0.5;
+
+  // Inset (in LS numbers); no inset if insetBegin >= insetEnd. The y range is automatic if insetMin and
+  // insetMax are both 0.
+  int insetBegin = 0, insetEnd = 0;
+  double insetMin = 0, insetMax = 0;
+
+  // Position of the "CMS Preliminary" label in the plot coordinates; if labelY is 0 it goes just above the
+  // top left corner of the plot instead.
+  double labelX = 0, labelY = 0;
+
+  // Per-bunch data: if bunches is set, the luminosity for each LS is summed over the selected bunches from
+  // the brilcalc --xing output (<csvDir>/<fill>_<detector>_xing.csv) instead of taken from the --byls total.
+  // It can be "all", "colliding", "leading", "train" or a list of BX like "1,41-50" (see selectBX); the
+  // colliding bunches are found from the first luminometer, and the same bunches are used for all of them.
+  std::string bunches;
+  // If set (to one of the detectors), each luminometer is plotted divided by this one, leaving out the zeroed
+  // LS. With per-bunch data, the ratio in each selected BX over the whole fill is also plotted, in
+  // <outputName>_bxratio.pdf/png.
+  std::string ratioTo;
+
+  bool decimate = true;
+  bool reportDecimation = false;
+};
+
+// VdMFillLumi<fill>, with _<bunches> and _over<ratioTo> added if they're set, so that the per-bunch and
+// ratio versions don't overwrite the plain plot.
+inline std::string defaultOutputName(const VdMPlotConfig &config) {
+  std::string name = "VdMFillLumi" + std::to_string(config.fill);
+  if (!config.bunches.empty()) name += "_" + config.bunches;
+  if (!config.ratioTo.empty()) name += "_over" + config.ratioTo;
+  return name;
+}
+
+inline int defaultDetectorColor(const std::string &detector, int i) {
+  if (detector == "HFET") return kMagenta;
+  if (detector == "HFOC") return kBlack;
+  if (detector == "PLT") return kRed;
+  if (detector == "BCM1F") return kBlue;
+  if (detector == "PCC") return 8;
+  const int others[] = {kOrange+1, kCyan+2, kViolet, kGray+2};
+  return others[i % 4];
+}
+
+// Replaces the points in the graph with the n points (x[i], y[i]).
+inline void setPoints(TGraph *g, const float *x, const float *y, size_t n) {
+  g->Set(0);
+  for (size_t j=0; j<n; ++j) g->SetPoint(j, x[j], y[j]);
+}
+
+// Prints the canvas to the given file, returning how long it took (in seconds).
+inline double timedPrint(TCanvas *c, const std::string &fileName) {
+  auto start = std::chrono::steady_clock::now();
+  c->Print(fileName.c_str());
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+inline long fileSize(const std::string &fileName) {
+  struct stat st;
+  return (stat(fileName.c_str(), &st) == 0) ? st.st_size : 0;
+}
+
+// Reads the --xing files and sums each LS over the selected bunches, giving the same per-LS data as from the
+// --byls files (with the sums in place of delivered) so that the rest of the plotting doesn't need to know.
+// The bunch selection is returned in weights.
+inline bool readBunchSums(const VdMPlotConfig &config, const std::vector<std::string> &fileNames,
+			  std::vector<BunchLumiData> &bunchData, AlignedFloats &weights, std::vector<BrilcalcLumiData> &csvData) {
+  bunchData.assign(fileNames.size(), BunchLumiData());
+  csvData.assign(fileNames.size(), BrilcalcLumiData());
+  for (size_t i=0; i<fileNames.size(); ++i) {
+    // Each file is already read with all the cores, so no need to read several at once.
+    if (!loadBrilcalcXing(fileNames[i].c_str(), bunchData[i])) return false;
+    if (i == 0 && !selectBX(config.bunches, bunchData[0], weights)) {
+      std::cerr << "ERROR: bad bunch selection: " << config.bunches << std::endl;
+      return false;
+    }
+    csvData[i] = bunchData[i].perLS;
+    sumPerLS(bunchData[i], weights.data(), csvData[i].delivered);
+  }
+  return true;
+}
+
+// Draws the ratio of each luminometer to config.ratioTo in each selected BX, summed over the LS they have
+// in common, to <outputName>_bxratio.pdf/png.
+inline void drawBXRatioPlot(const VdMPlotConfig &config, const std::vector<BunchLumiData> &bunchData,
+			    const AlignedFloats &weights, int ratioIndex, const std::vector<int> &colors,
+			    const std::string &outputName) {
+  const std::string fillName = std::to_string(config.fill);
+  TCanvas *c2 = new TCanvas(("cbx" + fillName).c_str(), ("cbx" + fillName).c_str(), 1400, 600);
+  c2->cd();
+  gPad->SetRightMargin(0.25);
+  LSIndex denIndex(bunchData[ratioIndex].perLS);
+  std::vector<TGraph*> g;
+  std::vector<int> detIndex;
+  float ymin = 1, ymax = 1;
+  for (size_t i=0; i<bunchData.size(); ++i) {
+    if (static_cast<int>(i) == ratioIndex) continue;
+    AlignedFloats ratio;
+    ratioPerBX(bunchData[i], bunchData[ratioIndex], denIndex, ratio);
+    std::vector<float> x, y;
+    for (int b=0; b<nBX; ++b) {
+      if (weights[b] == 0 || ratio[b] == 0) continue;
+      x.push_back(b+1);
+      y.push_back(ratio[b]);
+      ymin = std::min(ymin, ratio[b]);
+      ymax = std::max(ymax, ratio[b]);
+    }
+    g.push_back(new TGraph(x.size(), x.data(), y.data()));
+    g.back()->SetMarkerColor(colors[i]);
+    g.back()->SetMarkerStyle(kFullCircle);
+    g.back()->SetMarkerSize(0.6);
+    detIndex.push_back(i);
+  }
+  TH1 *frame = drawFrame(0, nBX + 1, ymin, ymax, false);
+  frame->SetTitle("");
+  frame->GetXaxis()->SetTitle("BX number");
+  frame->GetYaxis()->SetTitle(("Ratio to " + config.ratioTo).c_str());
+  frame->GetXaxis()->SetTitleSize(0.05);
+  frame->GetXaxis()->SetTitleOffset(0.9);
+  frame->GetXaxis()->SetLabelSize(0.04);
+  frame->GetYaxis()->SetLabelSize(0.04);
+  frame->GetYaxis()->SetTitleSize(0.05);
+  frame->GetYaxis()->SetTitleOffset(0.5);
+  TLegend *l = new TLegend(0.8, 0.6, 0.95, 0.9);
+  for (size_t k=0; k<g.size(); ++k) {
+    g[k]->Draw("P");
+    l->AddEntry(g[k], config.detectors[detIndex[k]].c_str(), "P");
+  }
+  l->SetBorderSize(0);
+  l->Draw();
+  timedPrint(c2, outputName + "_bxratio.pdf");
+  timedPrint(c2, outputName + "_bxratio.png");
+}
+
+// Makes the plot. Returns 0 on success, or 1 if something couldn't be read.
+inline int drawVdMLumiPlot(const VdMPlotConfig &config) {
+  const int nLumis = config.detectors.size();
+  if (nLumis == 0) {
+    std::cerr << "ERROR: no luminometers given for fill " << config.fill << std::endl;
+    return 1;
+  }
+  const std::string fillName = std::to_string(config.fill);
+  const std::string outputName = config.outputName.empty() ? defaultOutputName(config) : config.outputName;
+  std::vector<int> colors(config.colors);
+  for (int i=colors.size(); i<nLumis; ++i) colors.push_back(defaultDetectorColor(config.detectors[i], i));
+  int ratioIndex = -1;
+  if (!config.ratioTo.empty()) {
+    ratioIndex = std::find(config.detectors.begin(), config.detectors.end(), config.ratioTo) - config.detectors.begin();
+    if (ratioIndex == nLumis) {
+      std::cerr << "ERROR: " << config.ratioTo << " is not one of the luminometers for fill " << config.fill << std::endl;
+      return 1;
+    }
+  }
+
+  // lumisection number and lumi value for all the luminometers
+  std::vector<std::vector<int> > lumiDataLS(nLumis);
+  std::vector<std::vector<float> > lumiDataX(nLumis);
+  std::vector<std::vector<float> > lumiDataY(nLumis);
+  // and the same laid out on the broken x axis
+  std::vector<SegmentedSeries> lumiSeries(nLumis);
+
+  // Read all the files in parallel (the --xing ones one at a time, since each is already read with all the
+  // cores). The parsed data is cached in <file>.lumicache, so rerunning this is fast as long as the csv files
+  // don't change.
+  const bool perBunch = !config.bunches.empty();
+  std::vector<std::string> fileNames;
+  for (int i=0; i<nLumis; ++i)
+    fileNames.push_back(config.csvDir + "/" + fillName + "_" + config.detectors[i] + (perBunch ? "_xing.csv" : ".csv"));
+  std::vector<BrilcalcLumiData> csvData;
+  std::vector<BunchLumiData> bunchData;
+  AlignedFloats bunchWeights;
+  StageTimer readTimer("read");
+  if (perBunch) {
+    if (!readBunchSums(config, fileNames, bunchData, bunchWeights, csvData)) return 1;
+  } else {
+    if (!readBrilcalcByLSParallel(fileNames, csvData, true)) return 1;
+  }
+  readTimer.stop();
+  size_t nLSRead = 0;
+  for (const BrilcalcLumiData &data : csvData) nLSRead += data.size();
+  Profiler::instance().setMetric("ls_read", nLSRead);
+
+  // The first luminometer defines the LS numbering. Then each luminometer only writes to its own vectors,
+  // so we can fill them in parallel too.
+  StageTimer mergeTimer("merge");
+  LSIndex lsIndex(csvData[0]);
+  std::vector<std::ostringstream> warnings(nLumis);
+  parallelFor(nLumis, [&](int i) {
+    const BrilcalcLumiData &data = csvData[i];
+    lumiDataLS[i].reserve(data.size());
+    lumiDataY[i].reserve(data.size());
+    for (size_t j=0; j<data.size(); ++j) {
+      int thisls = (i == 0) ? j : lsIndex.find(data.run[j], data.ls[j]);
+      if (thisls < 0) {
+	warnings[i] << "Warning: found run/fill/LS " << data.run[j] << ":" << data.fill[j] << " " << data.ls[j] << ":" << data.cmsls[j] << " not in list of LS from first luminometer" << std::endl;
+	continue;
+      }
+      lumiDataLS[i].push_back(thisls);
+      lumiDataY[i].push_back(data.delivered[j]);
+    } // LS loop
+    sortByX(lumiDataLS[i], lumiDataY[i]);
+    lumiDataX[i].assign(lumiDataLS[i].begin(), lumiDataLS[i].end());
+  }); // luminometer loop
+
+  for (int i=0; i<nLumis; ++i) {
+    std::cout << warnings[i].str();
+    std::cout << "Processed " << csvData[i].size() << " LS for " << config.detectors[i] << std::endl;
+  }
+
+  // Work out the gaps.
+  std::vector<LSRange> zeroedRanges(config.zeroedRanges);
+  std::vector<LSRange> axisCuts(config.axisCuts);
+  std::vector<LSRange> badRanges;
+  if (!config.gapFile.empty()) {
+    LumiMask gapMask;
+    if (!gapMask.read(config.gapFile.c_str())) return 1;
+    badRanges = rangesFromMask(gapMask, csvData[0]);
+  }
+  if (config.autoGaps) {
+    std::vector<LSRange> low = findLowRanges(lumiDataX[0], lumiDataY[0], config.lowFraction, config.minCutLength);
+    badRanges.insert(badRanges.end(), low.begin(), low.end());
+  }
+  normalizeRanges(badRanges);
+  std::vector<LSRange> badCuts = cutsFromBadRanges(badRanges, config.gapMargin, config.minCutLength);
+  zeroedRanges.insert(zeroedRanges.end(), badRanges.begin(), badRanges.end());
+  axisCuts.insert(axisCuts.end(), badCuts.begin(), badCuts.end());
+  normalizeRanges(zeroedRanges);
+
+  if (ratioIndex >= 0) {
+    // Divide by the other luminometer in the same LS (matched by the LS number, not the plotted x); LS where
+    // it has no data (or 0) are dropped.
+    std::vector<float> denominator(lsIndex.size(), 0);
+    for (size_t j=0; j<lumiDataLS[ratioIndex].size(); ++j) denominator[lumiDataLS[ratioIndex][j]] = lumiDataY[ratioIndex][j];
+    parallelFor(nLumis, [&](int i) {
+      size_t n = 0;
+      for (size_t j=0; j<lumiDataLS[i].size(); ++j) {
+	float den = denominator[lumiDataLS[i][j]];
+	if (den == 0) continue;
+	lumiDataLS[i][n] = lumiDataLS[i][j];
+	lumiDataX[i][n] = lumiDataX[i][j];
+	lumiDataY[i][n++] = lumiDataY[i][j]/den;
+      }
+      lumiDataLS[i].resize(n);
+      lumiDataX[i].resize(n);
+      lumiDataY[i].resize(n);
+    });
+  }
+
+  const BrokenLSAxis axis(axisCuts);
+  parallelFor(nLumis, [&](int i) {
+    std::vector<LSRange> excluded;
+    auto exclude = config.excludedRanges.find(config.detectors[i]);
+    if (exclude != config.excludedRanges.end()) excluded = exclude->second;
+    // A zeroed LS would be a ratio of 0, which means nothing, so in ratio plots they're left out instead.
+    if (ratioIndex >= 0) excluded.insert(excluded.end(), zeroedRanges.begin(), zeroedRanges.end());
+    normalizeRanges(excluded);
+    layoutSeries(lumiDataX[i], lumiDataY[i], axis, (ratioIndex >= 0) ? std::vector<LSRange>() : zeroedRanges, excluded,
+		 config.maxStep, lumiSeries[i]);
+    auto split = config.splitPoints.find(config.detectors[i]);
+    if (split == config.splitPoints.end()) return;
+    for (int ls : split->second) splitSegmentsAt(lumiSeries[i], axis.toDisplay(ls));
+  });
+  mergeTimer.stop();
+
+  // Phew. Now put the data into some graphs and draw them.
+  gStyle->SetOptStat(0);
+  TCanvas *c1 = new TCanvas(("c" + fillName).c_str(), ("c" + fillName).c_str(), 1400, 600);
+  c1->cd();
+  gPad->SetRightMargin(0.25);
+
+  // The range covered by the data (on the broken axis), which is also what the decimation buckets span. The
+  // luminosity is shown down to 0, but ratios (which are all around 1) only over the range they cover.
+  float xmin = 0, xmax = 0;
+  float ymin = (ratioIndex >= 0) ? std::numeric_limits<float>::max() : 0;
+  float ymax = (ratioIndex >= 0) ? std::numeric_limits<float>::lowest() : 0;
+  for (int i=0; i<nLumis; ++i) {
+    if (lumiSeries[i].x.empty()) continue;
+    xmin = std::min(xmin, lumiSeries[i].x.front());
+    xmax = std::max(xmax, lumiSeries[i].x.back());
+    for (float y : lumiSeries[i].y) {
+      ymin = std::min(ymin, y);
+      ymax = std::max(ymax, y);
+    }
+  }
+  if (ymin > ymax) ymin = ymax = 0;
+  int nPixels = config.decimate ? plotPixelWidth(c1) : 0;
+  std::vector<SegmentedSeries> decimated(nLumis);
+  StageTimer decimateTimer("decimate");
+  for (int i=0; i<nLumis; ++i) decimated[i] = decimateSegments(lumiSeries[i], xmin, xmax, nPixels);
+  decimateTimer.stop();
+  std::vector<std::vector<TGraph*> > g(nLumis);
+  StageTimer graphTimer("graph");
+  for (int i=0; i<nLumis; ++i) {
+    g[i] = makeSegmentGraphs(decimated[i]);
+    for (TGraph *seg : g[i]) seg->SetLineColor(colors[i]);
+  }
+  graphTimer.stop();
+
+  double frameXmin = xmin, frameXmax = xmax;
+  float frameYmin = ymin, frameYmax = ymax;
+  const bool fromReference = ratioIndex < 0 && !lumiSeries[0].y.empty();
+  if (config.frameXMax != 0) {
+    frameXmin = config.frameXMin;
+    frameXmax = config.frameXMax;
+  } else if (config.xRangeFromReference && fromReference) {
+    const double dx = 0.1*(lumiSeries[0].x.back() - lumiSeries[0].x.front());
+    frameXmin = (lumiSeries[0].x.front() >= 0 && lumiSeries[0].x.front() - dx < 0) ? 0 : lumiSeries[0].x.front() - dx;
+    frameXmax = lumiSeries[0].x.back() + dx;
+  }
+  if (config.yRangeFromReference && fromReference) {
+    frameYmin = *std::min_element(lumiSeries[0].y.begin(), lumiSeries[0].y.end());
+    frameYmax = *std::max_element(lumiSeries[0].y.begin(), lumiSeries[0].y.end());
+  }
+  // Without any cuts, the frame's own x axis does the job of the broken one.
+  const bool brokenAxis = !axis.cuts().empty();
+  TH1 *frame = drawFrame(frameXmin, frameXmax, frameYmin, frameYmax, brokenAxis);
+  frame->SetTitle("");
+  frame->GetXaxis()->SetTitle("Luminosity section number since beginning of fill");
+  frame->GetYaxis()->SetTitle(ratioIndex >= 0 ? ("Ratio to " + config.ratioTo).c_str() : "Instantaneous luminosity (Hz/#mub)");
+  if (!brokenAxis) frame->GetXaxis()->SetLabelSize(0.04);
+  frame->GetXaxis()->SetTitleSize(0.05);
+  frame->GetXaxis()->SetTitleOffset(0.9);
+  frame->GetYaxis()->SetLabelSize(0.04);
+  frame->GetYaxis()->SetTitleSize(0.05);
+  frame->GetYaxis()->SetTitleOffset(config.yTitleOffset);
+
+  c1->Update();
+  // Draw the shaded boxes.
+  std::vector<LSRange> boxRanges;
+  for (const RunLSBox &b : config.boxes)
+    boxRanges.push_back({lsIndex.find(b.run1, b.ls1), lsIndex.find(b.run2, b.ls2)});
+  if (!config.boxFile.empty()) {
+    LumiMask boxMask;
+    if (!boxMask.read(config.boxFile.c_str())) return 1;
+    std::vector<LSRange> fromFile = rangesFromMask(boxMask, csvData[0]);
+    boxRanges.insert(boxRanges.end(), fromFile.begin(), fromFile.end());
+  }
+  double boxBottom = 0, boxTop = (config.boxTop != 0) ? config.boxTop : 1.05*ymax;
+  if (ratioIndex >= 0) {
+    boxBottom = gPad->GetUymin();
+    boxTop = gPad->GetUymax();
+  }
+  for (const LSRange &r : boxRanges) {
+    TBox *b = new TBox(axis.toDisplay(r.first), boxBottom, axis.toDisplay(r.last), boxTop);
+    b->SetLineColor(18);
+    b->SetFillColor(18);
+    b->Draw();
+  }
+
+  for (int i=0; i<nLumis; ++i) {
+    for (TGraph *seg : g[i]) seg->Draw("L");
+  }
+
+  // The x axis, with true LS numbers and the nifty little "cutout" bits.
+  if (brokenAxis)
+    drawBrokenXAxis(axis, lumiDataX[0].empty() ? 0 : lumiDataX[0].front(), lumiDataX[0].empty() ? 0 : lumiDataX[0].back(), 0.06);
+
+  TLegend *l = new TLegend(0.8, 0.6, 0.95, 0.9);
+  for (int i=0; i<nLumis; ++i) {
+    if (!g[i].empty()) l->AddEntry(g[i][0], config.detectors[i].c_str(), "L");
+  }
+  l->SetBorderSize(0);
+  l->Draw();
+
+  // CMS Preliminary
+  TText *t1 = (config.labelY != 0) ? new TText(config.labelX, config.labelY, "CMS Preliminary") : new TText(0.1, 0.92, "CMS Preliminary");
+  if (config.labelY == 0) t1->SetNDC();
+  t1->SetTextSize(0.05);
+  t1->SetTextFont(62);
+  t1->Draw();
+
+  // Inset
+  TPad *p2 = nullptr;
+  std::vector<TGraph*> gi;
+  if (config.insetBegin < config.insetEnd) {
+    p2 = new TPad(("p" + fillName).c_str(), ("p" + fillName).c_str(), 0.77, 0.06, 0.98, 0.57);
+    p2->SetLeftMargin(0.2);
+    p2->SetRightMargin(0.01);
+    p2->SetTopMargin(0.04);
+    p2->SetBottomMargin(0.2);
+    p2->Draw();
+    p2->cd();
+    // The inset is decimated separately from the full-resolution data, to the resolution of the inset pad.
+    int nInsetPixels = config.decimate ? plotPixelWidth(p2) : 0;
+    std::vector<std::vector<float> > insetX(nLumis), insetY(nLumis);
+    StageTimer insetTimer("decimate");
+    for (int i=0; i<nLumis; ++i)
+      decimateMinMax(lumiDataX[i].data(), lumiDataY[i].data(), lumiDataX[i].size(), config.insetBegin, config.insetEnd, nInsetPixels, insetX[i], insetY[i]);
+    insetTimer.stop();
+    StageTimer insetGraphTimer("graph");
+    for (int i=0; i<nLumis; ++i) {
+      gi.push_back(new TGraph(insetX[i].size(), insetX[i].data(), insetY[i].data()));
+      gi[i]->SetLineColor(colors[i]);
+    }
+    insetGraphTimer.stop();
+    // Draw the last one (PCC, usually) first so it doesn't cover up everything else.
+    TGraph *first = gi[nLumis-1];
+    first->Draw("AL");
+    first->SetTitle("");
+    first->GetXaxis()->SetTitle("LS number");
+    first->GetYaxis()->SetTitle(ratioIndex >= 0 ? ("Ratio to " + config.ratioTo).c_str() : "Inst. luminosity (Hz/#mub)");
+    first->GetXaxis()->SetLabelSize(0.06);
+    first->GetXaxis()->SetTitleSize(0.06);
+    first->GetXaxis()->SetTitleOffset(0.9);
+    first->GetYaxis()->SetLabelSize(0.06);
+    first->GetYaxis()->SetTitleSize(0.06);
+    first->GetYaxis()->SetTitleOffset(1.5);
+    if (config.insetMin != 0 || config.insetMax != 0) {
+      first->SetMinimum(config.insetMin);
+      first->SetMaximum(config.insetMax);
+    }
+    first->GetXaxis()->SetNdivisions(505);
+    for (int i=0; i<nLumis-1; ++i) {
+      gi[i]->Draw("same");
+    }
+  }
+  StageTimer renderTimer("render");
+  double printTime = timedPrint(c1, outputName + ".pdf") + timedPrint(c1, outputName + ".png");
+  renderTimer.stop();
+  if (Profiler::instance().enabled()) {
+    size_t nDrawn = 0;
+    for (int i=0; i<nLumis; ++i) {
+      for (TGraph *seg : g[i]) nDrawn += seg->GetN();
+      if (!gi.empty()) nDrawn += gi[i]->GetN();
+    }
+    Profiler::instance().setMetric("points_drawn", nDrawn);
+  }
+
+  if (config.decimate && config.reportDecimation) {
+    // Put all the points back in the graphs, print again, and compare.
+    size_t nPoints = 0, nDecimated = 0;
+    for (int i=0; i<nLumis; ++i) {
+      for (size_t k=0; k<g[i].size(); ++k) {
+	nDecimated += g[i][k]->GetN();
+	setPoints(g[i][k], lumiSeries[i].segmentX(k), lumiSeries[i].segmentY(k), lumiSeries[i].segmentSize(k));
+	nPoints += g[i][k]->GetN();
+      }
+      if (gi.empty()) continue;
+      nDecimated += gi[i]->GetN();
+      std::vector<float> insetX, insetY;
+      decimateMinMax(lumiDataX[i].data(), lumiDataY[i].data(), lumiDataX[i].size(), config.insetBegin, config.insetEnd, 0, insetX, insetY);
+      setPoints(gi[i], insetX.data(), insetY.data(), insetX.size());
+      nPoints += gi[i]->GetN();
+    }
+    if (p2) p2->Modified();
+    c1->Modified();
+    c1->Update();
+    double fullPrintTime = timedPrint(c1, outputName + "_full.pdf") + timedPrint(c1, outputName + "_full.png");
+    long pdfSize = fileSize(outputName + ".pdf");
+    long fullPdfSize = fileSize(outputName + "_full.pdf");
+    std::cout << "Decimation: " << nPoints << " -> " << nDecimated << " points" << std::endl;
+    std::cout << "PDF size: " << fullPdfSize << " -> " << pdfSize << " bytes (saved " << fullPdfSize - pdfSize << ")" << std::endl;
+    std::cout << "Render time: " << fullPrintTime << " -> " << printTime << " s (saved " << fullPrintTime - printTime << ")" << std::endl;
+    std::remove((outputName + "_full.pdf").c_str());
+    std::remove((outputName + "_full.png").c_str());
+  }
+
+  if (perBunch && ratioIndex >= 0) {
+    StageTimer ratioTimer("render");
+    drawBXRatioPlot(config, bunchData, bunchWeights, ratioIndex, colors, outputName);
+  }
+  Profiler::instance().writeReport("makeVdMLumiPlot", "fill " + fillName, outputName + "_profile.json");
+  return 0;
+}
+
+} // namespace brilcsv
+
+#endif
@@ -0,0 +1,321 @@
+// Batch version of makeVdMLumiPlot: makes the VdM fill luminosity plot (see VdMLumiPlot.h) for every fill in
+// a list, running several fills at once in separate worker processes with ROOT in batch mode. Since this is
+// a normal compiled program, there's no ACLiC compilation every time you run it. Compile it with:
+// g++ -O2 -std=c++17 -pthread -o batchVdMLumiPlots batchVdMLumiPlots.cc $(root-config --cflags --libs)
+// and run it with:
+// ./batchVdMLumiPlots [-j nworkers] [-o outdir] [--nodecimate] [--profile] fills.txt
+//
+// Each line of the fill list looks like:
+// 6868 HFET:HFOC:PLT:BCM1F:PCC hfet18PAS:hfoc18PAS:pltReproc18PAS:bcm1f18PAS:pcc18PAS inset=3313-3376
+// i.e. the fill, the luminometers (the first one is the reference for the LS numbering), and the normtags
+// for them (or - if you don't want to give any; this can't be left out), followed by any of these options:
+//   dir=path          directory with the <fill>_<detector>.csv files (default .)
+//   colors=c1:c2:...  ROOT color numbers for the luminometers, in the same order (default by detector name)
+//   zero=a-b,c-d,...  LS ranges to draw as zero
+//   cut=a-b,...       LS ranges to cut out of the x axis
+//   exclude=det:a-b   LS ranges (a-b,c-d,...) to leave out of the graph for luminometer det altogether
+//   split=det:ls      LS (ls1,ls2,...) where the line for luminometer det is broken even without a gap there
+//   maxstep=n         break the lines where more than n LS are missing (default 10), or maxstep=none to never
+//   gaps=file.json    json file of bad periods to zero and cut (see VdMPlotConfig), or gaps=auto to find them
+//   boxes=file.json   json file of periods to shade, e.g. vdm2018.json
+//   box=r:ls-r:ls,... periods to shade, from run r1 LS ls1 to run r2 LS ls2 (inclusive)
+//   boxtop=y          height of the shaded boxes (default 5% above the highest point)
+//   frame=a-b         x range of the plot, on the axis with the cuts taken out (default the whole fill), or
+//                     frame=ref for that of the first luminometer plus 10% on either side
+//   yrange=ref        take the y range from the first luminometer only, rather than all of them
+//   ytitleoffset=x    offset of the y axis title (default 0.5)
+//   label=x,y         position of the "CMS Preliminary" label (default just above the top left corner)
+//   inset=a-b         LS range for the inset
+//   insety=min-max    y range for the inset
+//   bunches=sel       use the per-bunch (--xing) data, <fill>_<detector>_xing.csv, summed over the selected
+//                     bunches: all, colliding, leading, train, or a list like 1,41-50
+//   ratio=detector    plot each luminometer divided by this one (and, with bunches=, the ratio per BX)
+// Lines starting with # are ignored. If a csv file is missing and a normtag was given for that luminometer,
+// it's made with brilcalc first (brilcalc lumi -f <fill> --byls [--xing] -u hz/ub -b "STABLE BEAMS" --normtag ...).
+// The output for each fill is <outdir>/VdMFillLumi<fill>.pdf and .png (with _<bunches> and _over<detector>
+// added for bunches= and ratio=, see defaultOutputName in VdMLumiPlot.h), and everything it prints goes to
+// <outdir>/VdMFillLumi<fill>.log. With --profile (or PAPERPLOTS_PROFILE set), the time and memory used by each
+// stage, and the number of allocations, go to <outdir>/VdMFillLumi<fill>_profile.json (see PipelineProfiler.h).
+// Two lines that would write the same files (the same fill, bunches and ratio) are an error.
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <cerrno>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "TROOT.h"
+#include "TError.h"
+// Count the allocations in the profile reports. This has to be defined in exactly one source file.
+#define PAPERPLOTS_COUNT_ALLOCATIONS
+#include "PipelineProfiler.h"
+#include "VdMLumiPlot.h"
+
+namespace {
+
+struct FillJob {
+  brilcsv::VdMPlotConfig config;
+  std::vector<std::string> normtags;
+};
+
+std::vector<std::string> split(const std::string &s, char sep) {
+  std::vector<std::string> parts;
+  std::stringstream ss(s);
+  std::string part;
+  while (std::getline(ss, part, sep))
+    if (!part.empty()) parts.push_back(part);
+  return parts;
+}
+
+// Parses "a-b" (which may be floating point for insety).
+bool parseRange(const std::string &s, double &a, double &b) {
+  size_t dash = s.find('-', 1);
+  if (dash == std::string::npos) return false;
+  const std::string first = s.substr(0, dash), second = s.substr(dash+1);
+  char *end1, *end2;
+  a = strtod(first.c_str(), &end1);
+  b = strtod(second.c_str(), &end2);
+  return !first.empty() && !second.empty() && *end1 == 0 && *end2 == 0;
+}
+
+bool parseLSRanges(const std::string &s, std::vector<brilcsv::LSRange> &ranges) {
+  for (const std::string &r : split(s, ',')) {
+    double a, b;
+    if (!parseRange(r, a, b)) return false;
+    ranges.push_back({static_cast<int>(a), static_cast<int>(b)});
+  }
+  return true;
+}
+
+// Parses "run1:ls1-run2:ls2,..." into boxes.
+bool parseBoxes(const std::string &s, std::vector<brilcsv::RunLSBox> &boxes) {
+  for (const std::string &r : split(s, ',')) {
+    brilcsv::RunLSBox b;
+    char end;
+    if (sscanf(r.c_str(), "%d:%d-%d:%d%c", &b.run1, &b.ls1, &b.run2, &b.ls2, &end) != 4) return false;
+    boxes.push_back(b);
+  }
+  return true;
+}
+
+// Parses "det:a-b,c-d,..." (for exclude=) or "det:a,b,..." (for split=) into the entry for det in the map.
+bool parseDetectorRanges(const std::string &s, std::map<std::string, std::vector<brilcsv::LSRange> > &ranges) {
+  size_t colon = s.find(':');
+  return colon != std::string::npos && colon > 0 && parseLSRanges(s.substr(colon+1), ranges[s.substr(0, colon)]);
+}
+
+bool parseDetectorPoints(const std::string &s, std::map<std::string, std::vector<int> > &points) {
+  size_t colon = s.find(':');
+  if (colon == std::string::npos || colon == 0) return false;
+  std::vector<int> &p = points[s.substr(0, colon)];
+  for (const std::string &v : split(s.substr(colon+1), ',')) {
+    char *end;
+    p.push_back(strtol(v.c_str(), &end, 10));
+    if (*end != 0) return false;
+  }
+  return !p.empty();
+}
+
+bool parseColors(const std::string &s, std::vector<int> &colors) {
+  for (const std::string &v : split(s, ':')) {
+    char *end;
+    colors.push_back(strtol(v.c_str(), &end, 10));
+    if (*end != 0) return false;
+  }
+  return !colors.empty();
+}
+
+bool parseFillLine(const std::string &line, FillJob &job) {
+  std::istringstream ss(line);
+  std::string detectors, normtags, option;
+  if (!(ss >> job.config.fill >> detectors >> normtags)) return false;
+  job.config.detectors = split(detectors, ':');
+  // An option here means the normtags were left out.
+  if (normtags.find('=') != std::string::npos) return false;
+  if (normtags != "-") job.normtags = split(normtags, ':');
+  while (ss >> option) {
+    size_t eq = option.find('=');
+    if (eq == std::string::npos) return false;
+    std::string key = option.substr(0, eq), value = option.substr(eq+1);
+    double a, b;
+    if (key == "dir") job.config.csvDir = value;
+    else if (key == "colors") { if (!parseColors(value, job.config.colors)) return false; }
+    else if (key == "zero") { if (!parseLSRanges(value, job.config.zeroedRanges)) return false; }
+    else if (key == "cut") { if (!parseLSRanges(value, job.config.axisCuts)) return false; }
+    else if (key == "exclude") { if (!parseDetectorRanges(value, job.config.excludedRanges)) return false; }
+    else if (key == "split") { if (!parseDetectorPoints(value, job.config.splitPoints)) return false; }
+    else if (key == "maxstep" && value == "none") job.config.maxStep = INT_MAX;
+    else if (key == "maxstep") job.config.maxStep = atoi(value.c_str());
+    else if (key == "gaps" && value == "auto") job.config.autoGaps = true;
+    else if (key == "gaps") job.config.gapFile = value;
+    else if (key == "boxes") job.config.boxFile = value;
+    else if (key == "box") { if (!parseBoxes(value, job.config.boxes)) return false; }
+    else if (key == "frame" && value == "ref") job.config.xRangeFromReference = true;
+    else if (key == "frame" && parseRange(value, a, b)) { job.config.frameXMin = a; job.config.frameXMax = b; }
+    else if (key == "yrange" && value == "ref") job.config.yRangeFromReference = true;
+    else if (key == "ytitleoffset") job.config.yTitleOffset = atof(value.c_str());
+    else if (key == "label" && sscanf(value.c_str(), "%lf,%lf", &a, &b) == 2) { job.config.labelX = a; job.config.labelY = b; }
+    else if (key == "boxtop") job.config.boxTop = atof(value.c_str());
+    else if (key == "inset" && parseRange(value, a, b)) { job.config.insetBegin = a; job.config.insetEnd = b; }
+    else if (key == "insety" && parseRange(value, a, b)) { job.config.insetMin = a; job.config.insetMax = b; }
+    else if (key == "bunches") job.config.bunches = value;
+    else if (key == "ratio") job.config.ratioTo = value;
+    else return false;
+  }
+  return !job.config.detectors.empty();
+}
+
+// Makes any missing csv files with brilcalc. Returns false if one is still missing.
+bool makeMissingCSV(const FillJob &job) {
+  const bool perBunch = !job.config.bunches.empty();
+  for (size_t i=0; i<job.config.detectors.size(); ++i) {
+    std::string csv = job.config.csvDir + "/" + std::to_string(job.config.fill) + "_" + job.config.detectors[i] +
+      (perBunch ? "_xing.csv" : ".csv");
+    if (access(csv.c_str(), R_OK) == 0 || i >= job.normtags.size()) continue;
+    std::string command = "brilcalc lumi -f " + std::to_string(job.config.fill) + " --byls" + (perBunch ? " --xing" : "") +
+      " -u hz/ub -b \"STABLE BEAMS\" -o " + csv + " --normtag " + job.normtags[i];
+    std::cout << command << std::endl;
+    if (std::system(command.c_str()) != 0) {
+      std::cerr << "ERROR: brilcalc failed for " << csv << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Makes the directory, and any missing parents, like mkdir -p. Returns false if it can't.
+bool makeDirectories(const std::string &path) {
+  for (size_t slash = path.find('/', 1); ; slash = path.find('/', slash + 1)) {
+    const std::string dir = path.substr(0, slash);
+    if (!dir.empty() && mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    if (slash == std::string::npos) break;
+  }
+  struct stat st;
+  return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+// This is what runs in each worker process.
+int runFill(const FillJob &job, bool profile) {
+  gROOT->SetBatch(true);
+  gErrorIgnoreLevel = kWarning; // don't fill the log with "Info in <TCanvas::Print>"
+  // Each fill gets its own report, counting from the start of the worker.
+  if (profile || brilcsv::Profiler::instance().enabled())
+    brilcsv::Profiler::instance().enable(job.config.outputName + "_profile.json");
+  if (!makeMissingCSV(job)) return 1;
+  return brilcsv::drawVdMLumiPlot(job.config);
+}
+
+}
+
+int main(int argc, char **argv) {
+  int nWorkers = std::max(1u, std::thread::hardware_concurrency());
+  std::string outDir = ".";
+  bool decimate = true;
+  bool profile = false;
+  bool usageError = false;
+  const char *fillList = nullptr;
+  for (int i=1; i<argc; ++i) {
+    if (!strcmp(argv[i], "-j") && i+1 < argc) nWorkers = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "-o") && i+1 < argc) outDir = argv[++i];
+    else if (!strcmp(argv[i], "--nodecimate")) decimate = false;
+    else if (!strcmp(argv[i], "--profile")) profile = true;
+    else if (argv[i][0] != '-' && !fillList) fillList = argv[i];
+    else {
+      usageError = true;
+      break;
+    }
+  }
+  if (usageError || !fillList) {
+    std::cerr << "Usage: " << argv[0] << " [-j nworkers] [-o outdir] [--nodecimate] [--profile] fills.txt" << std::endl;
+    return 1;
+  }
+
+  std::ifstream listFile(fillList);
+  if (!listFile.is_open()) {
+    std::cerr << "ERROR: cannot open fill list: " << fillList << std::endl;
+    return 1;
+  }
+  std::vector<FillJob> jobs;
+  std::set<std::string> outputNames;
+  std::string line;
+  while (std::getline(listFile, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    FillJob job;
+    if (!parseFillLine(line, job)) {
+      std::cerr << "ERROR: malformed line in fill list: " << line << std::endl;
+      return 1;
+    }
+    job.config.outputName = outDir + "/" + brilcsv::defaultOutputName(job.config);
+    job.config.decimate = decimate;
+    // Two jobs writing the same files (at the same time, with -j) would make a mess of them.
+    if (!outputNames.insert(job.config.outputName).second) {
+      std::cerr << "ERROR: more than one line in fill list for " << job.config.outputName << ": " << line << std::endl;
+      return 1;
+    }
+    jobs.push_back(job);
+  }
+
+  if (!makeDirectories(outDir)) {
+    std::cerr << "ERROR: cannot create output directory: " << outDir << std::endl;
+    return 1;
+  }
+
+  // Run the fills on a pool of worker processes. ROOT graphics aren't thread-safe, so separate processes
+  // (each with its own canvases) are the safe way to run several at once.
+  gROOT->SetBatch(true);
+  std::map<pid_t, size_t> running;
+  std::vector<int> status(jobs.size(), -1);
+  std::vector<double> elapsed(jobs.size(), 0);
+  std::vector<std::chrono::steady_clock::time_point> started(jobs.size());
+  size_t next = 0;
+  while (next < jobs.size() || !running.empty()) {
+    while (next < jobs.size() && static_cast<int>(running.size()) < nWorkers) {
+      started[next] = std::chrono::steady_clock::now();
+      std::cout.flush();
+      pid_t pid = fork();
+      if (pid == 0) {
+	std::string log = jobs[next].config.outputName + ".log";
+	if (!freopen(log.c_str(), "w", stdout) || !freopen(log.c_str(), "a", stderr))
+	  _exit(1);
+	setvbuf(stderr, nullptr, _IONBF, 0);
+	int ret = runFill(jobs[next], profile);
+	std::cout.flush();
+	fflush(stdout);
+	_exit(ret);
+      } else if (pid < 0) {
+	std::cerr << "ERROR: cannot start worker process" << std::endl;
+	status[next++] = 1;
+	continue;
+      }
+      running[pid] = next++;
+    }
+    int wstatus;
+    pid_t pid = wait(&wstatus);
+    if (pid < 0) break;
+    auto it = running.find(pid);
+    if (it == running.end()) continue;
+    size_t j = it->second;
+    running.erase(it);
+    status[j] = (WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 1);
+    elapsed[j] = std::chrono::duration<double>(std::chrono::steady_clock::now() - started[j]).count();
+    std::cout << "Fill " << jobs[j].config.fill << ": " << (status[j] == 0 ? "done" : "FAILED") << " in " << elapsed[j]
+	      << " s (see " << jobs[j].config.outputName << ".log)" << std::endl;
+  }
+
+  int nFailed = 0;
+  for (int s : status) if (s != 0) ++nFailed;
+  std::cout << jobs.size() - nFailed << " of " << jobs.size() << " fills done" << std::endl;
+  return nFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+// Writes a synthetic set of input files for benchmarking the plotting pipelines (see runBenchmarks.sh): the
+// brilcalc lumi --byls csv files for one fill for the five 2018 luminometers, <fill>_HFET.csv etc. (each a
+// slightly different scale of the same luminosity curve), and an aging file HFOCAging.csv with the same
+// number of rows, in the formats read by VdMLumiPlot.h and LUM-18-002/makeHFAgingPlot.C. The files only
+// depend on the arguments (see SyntheticData.h), so benchmark results can be compared between runs. With
+// -a nAppend, it instead appends the next nAppend rows to the HFOCAging.csv made before with the same -n, like
+// new rows being added during data-taking, to benchmark the incremental fit. It doesn't need ROOT; compile it
+// with:
+// g++ -O2 -std=c++17 -o makeSyntheticLumi makeSyntheticLumi.cc
+// and run it with:
+// ./makeSyntheticLumi [-n nLS] [-f fill] [-o outdir] [-a nAppend]
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "SyntheticData.h"
+
+int main(int argc, char **argv) {
+  int nLS = 1000;
+  int fill = 6868;
+  int nAppend = 0;
+  std::string outDir = ".";
+  bool usageError = false;
+  for (int i=1; i<argc; ++i) {
+    if (!strcmp(argv[i], "-n") && i+1 < argc) nLS = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-f") && i+1 < argc) fill = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i+1 < argc) outDir = argv[++i];
+    else if (!strcmp(argv[i], "-a") && i+1 < argc) nAppend = atoi(argv[++i]);
+    else {
+      usageError = true;
+      break;
+    }
+  }
+  if (usageError || nLS <= 0 || fill <= 0 || nAppend < 0) {
+    std::cerr << "Usage: " << argv[0] << " [-n nLS] [-f fill] [-o outdir] [-a nAppend]" << std::endl;
+    return 1;
+  }
+
+  std::string agingName = outDir + "/HFOCAging.csv";
+  if (nAppend > 0) {
+    if (!brilcsv::writeSyntheticAging(agingName.c_str(), nLS, nAppend, nLS)) return 1;
+    std::cout << "Appended " << nAppend << " rows to " << agingName << std::endl;
+    return 0;
+  }
+
+  const char *detectors[] = {"HFET", "HFOC", "PLT", "BCM1F", "PCC"};
+  const double scales[] = {1.0, 0.99, 1.01, 0.98, 1.02};
+  for (int i=0; i<5; ++i) {
+    std::string fileName = outDir + "/" + std::to_string(fill) + "_" + detectors[i] + ".csv";
+    if (!brilcsv::writeSyntheticByLS(fileName.c_str(), nLS, fill, detectors[i], scales[i])) return 1;
+  }
+  if (!brilcsv::writeSyntheticAging(agingName.c_str(), 0, nLS, nLS)) return 1;
+  std::cout << "Wrote " << nLS << " LS for fill " << fill << " to " << outDir << std::endl;
+  return 0;
+}
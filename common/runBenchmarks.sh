@@ -0,0 +1,79 @@
+#!/bin/bash
+# Runs the VdM fill plot (batchVdMLumiPlots) and the HF aging plot (LUM-18-002/makeHFAgingPlot.C) on
+# synthetic inputs of increasing size (see makeSyntheticLumi.cc), with profiling turned on (see
+# PipelineProfiler.h), and collects the profile reports in <outdir>/results.json. For each size n (in LS) it
+# makes a fill with n LS for each of the five luminometers, and an aging file with n rows, in <outdir>/<n>/,
+# and then runs:
+#  - batchVdMLumiPlots without the .lumicache files (cold/) and again with them (warm/)
+#  - makeHFAgingPlot.C with the full fit (HFOCAging2018_profile.json), the incremental fit from scratch
+#    (HFOCAgingFirst_profile.json), and then, after appending 1% more rows to HFOCAging.csv, the incremental
+#    update that only reads the new rows (HFOCAgingIncremental_profile.json)
+# Everything is deterministic, so the numbers can be compared between machines and between versions of the
+# code. Run it from anywhere with ROOT set up:
+# ./runBenchmarks.sh [-o outdir] [n1 n2 ...]
+# The default sizes are 1000 10000 100000 1000000 10000000. The largest one needs about 6 GB of disk space and
+# a few GB of memory; give the sizes explicitly (e.g. 1000 10000 100000 1000000) to leave it out.
+
+here=$(cd "$(dirname "$0")" && pwd)
+outDir=benchmarks
+if [ "$1" = "-o" ]; then
+  outDir=$2
+  shift 2
+fi
+sizes="$*"
+if [ -z "$sizes" ]; then
+  sizes="1000 10000 100000 1000000 10000000"
+fi
+fill=6868
+
+g++ -O2 -std=c++17 -o "$here/makeSyntheticLumi" "$here/makeSyntheticLumi.cc" || exit 1
+g++ -O2 -std=c++17 -pthread -o "$here/batchVdMLumiPlots" "$here/batchVdMLumiPlots.cc" $(root-config --cflags --libs) || exit 1
+# Compile the macro once up front, so that isn't counted in the first run.
+root -l -b -q -e ".L $here/../LUM-18-002/makeHFAgingPlot.C++" > /dev/null || exit 1
+
+mkdir -p "$outDir" || exit 1
+outDir=$(cd "$outDir" && pwd)
+reports=()
+for n in $sizes; do
+  dir=$outDir/$n
+  echo "=== $n LS ==="
+  mkdir -p "$dir/cold" "$dir/warm" || exit 1
+  rm -f "$dir"/*.lumicache "$dir"/*.fitstate
+  "$here/makeSyntheticLumi" -n "$n" -f $fill -o "$dir" || exit 1
+  inset="$((n/2))-$((n/2 + 63))"
+  echo "$fill HFET:HFOC:PLT:BCM1F:PCC - dir=$dir inset=$inset" > "$dir/fills.txt"
+
+  for pass in cold warm; do
+    "$here/batchVdMLumiPlots" -j 1 -o "$dir/$pass" --profile "$dir/fills.txt" || exit 1
+    reports+=("$dir/$pass/VdMFillLumi${fill}_profile.json")
+  done
+
+  nAppend=$((n/100 > 0 ? n/100 : 1))
+  (cd "$dir" &&
+     PAPERPLOTS_PROFILE=1 root -l -b -q "$here/../LUM-18-002/makeHFAgingPlot.C++" > hfaging.log 2>&1 &&
+     PAPERPLOTS_PROFILE=HFOCAgingFirst_profile.json \
+       root -l -b -q "$here/../LUM-18-002/makeHFAgingPlot.C++(true, false)" >> hfaging.log 2>&1 &&
+     "$here/makeSyntheticLumi" -n "$n" -a $nAppend -o "$dir" >> hfaging.log 2>&1 &&
+     PAPERPLOTS_PROFILE=HFOCAgingIncremental_profile.json \
+       root -l -b -q "$here/../LUM-18-002/makeHFAgingPlot.C++(true, false)" >> hfaging.log 2>&1) || {
+    echo "ERROR: makeHFAgingPlot.C failed, see $dir/hfaging.log" >&2
+    exit 1
+  }
+  reports+=("$dir/HFOCAging2018_profile.json" "$dir/HFOCAgingFirst_profile.json" "$dir/HFOCAgingIncremental_profile.json")
+done
+
+# All the reports as one JSON list, each labelled with where it came from (e.g. "1000/cold/...").
+{
+  echo "["
+  sep=""
+  for r in "${reports[@]}"; do
+    rel=${r#$outDir/}
+    printf '%s{"run": "%s", "report":\n' "$sep" "$rel"
+    cat "$r"
+    printf '}'
+    sep=$',\n'
+  done
+  echo
+  echo "]"
+} > "$outDir/results.json"
+echo "Wrote $outDir/results.json"